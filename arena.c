@@ -0,0 +1,98 @@
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_HUGE_CHUNK_SIZE (2 << 20)
+#define ARENA_ALIGNMENT 16
+#define ARENA_HEADER_SIZE ((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+// Huge pages are only used for 2 MiB aligned memory, so a chunk is mapped
+// with 2 MiB to spare and trimmed to the first boundary in it
+static ArenaChunk *map_chunk(size_t size) {
+	size_t mapped = size + ARENA_HUGE_CHUNK_SIZE;
+	char *start = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (start == MAP_FAILED) {
+		return NULL;
+	}
+	char *p = (char *)(((uintptr_t)start + ARENA_HUGE_CHUNK_SIZE - 1) & ~((uintptr_t)ARENA_HUGE_CHUNK_SIZE - 1));
+	if (p > start) {
+		munmap(start, p - start);
+	}
+	if (start + mapped > p + size) {
+		munmap(p + size, start + mapped - (p + size));
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	ArenaChunk *chunk = (ArenaChunk *)p;
+	chunk->mapped = true;
+	return chunk;
+}
+
+static ArenaChunk *allocate_chunk(Arena *arena, size_t min_size) {
+	size_t default_size = arena->huge_pages ? ARENA_HUGE_CHUNK_SIZE : ARENA_CHUNK_SIZE;
+	size_t size = ARENA_HEADER_SIZE + min_size;
+	if (size < default_size) {
+		size = default_size;
+	}
+
+	ArenaChunk *chunk = NULL;
+	if (arena->huge_pages) {
+		size = (size + ARENA_HUGE_CHUNK_SIZE - 1) & ~((size_t)ARENA_HUGE_CHUNK_SIZE - 1);
+		chunk = map_chunk(size);
+	}
+	if (chunk == NULL) {
+		chunk = malloc(size);
+		if (chunk == NULL) {
+			fprintf(stderr, "Unable to allocate arena chunk of %zu bytes\n", size);
+			exit(1);
+		}
+		chunk->mapped = false;
+	}
+
+	chunk->prev = arena->chunk;
+	chunk->size = size;
+	chunk->used = ARENA_HEADER_SIZE;
+	arena->chunk = chunk;
+	arena->reserved += size;
+	arena->chunks++;
+	return chunk;
+}
+
+void arena_init(Arena *arena, bool huge_pages) {
+	arena->chunk = NULL;
+	arena->huge_pages = huge_pages;
+	arena->allocated = 0;
+	arena->reserved = 0;
+	arena->chunks = 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+	size = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+	ArenaChunk *chunk = arena->chunk;
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		chunk = allocate_chunk(arena, size);
+	}
+	void *p = (char *)chunk + chunk->used;
+	chunk->used += size;
+	arena->allocated += size;
+	return p;
+}
+
+void arena_free(Arena *arena) {
+	ArenaChunk *chunk = arena->chunk;
+	while (chunk != NULL) {
+		ArenaChunk *prev = chunk->prev;
+		if (chunk->mapped) {
+			munmap(chunk, chunk->size);
+		} else {
+			free(chunk);
+		}
+		chunk = prev;
+	}
+	arena_init(arena, arena->huge_pages);
+}
@@ -0,0 +1,26 @@
+#ifndef PENQUIN_ARENA_H
+#define PENQUIN_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ArenaChunk {
+	struct ArenaChunk *prev;
+	size_t size;
+	size_t used;
+	bool mapped;
+} ArenaChunk;
+
+typedef struct {
+	ArenaChunk *chunk;
+	bool huge_pages;
+	size_t allocated;
+	size_t reserved;
+	int chunks;
+} Arena;
+
+void  arena_init(Arena *arena, bool huge_pages);
+void *arena_alloc(Arena *arena, size_t size);
+void  arena_free(Arena *arena);
+
+#endif
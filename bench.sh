@@ -0,0 +1,19 @@
+#!/bin/sh
+
+set -e
+
+mkdir -p build
+
+echo "[table]"
+gcc -std=c11 -O2 -Wall -o build/bench_table bench/table.c table.c memory.c
+build/bench_table
+
+echo "[scan]"
+gcc -std=c11 -O2 -Wall -o build/bench_scan bench/scan.c token.c list.c file.c string.c memory.c
+build/bench_scan "${SCAN_TARGET_MBPS:-0}" res/*.pq std/*.pq
+
+echo "[compile]"
+bench/compile.sh build/bench_compile.json
+
+echo "[runtime]"
+bench/runtime.sh build/bench_runtime.json
@@ -0,0 +1,97 @@
+#!/bin/sh
+
+# Usage: bench/compile.sh [output.json]
+# Compiles generated projects of growing size with build/penquin and writes
+# lines/s, wall time per phase and peak RSS of each to output.json. With
+# BENCH_BASELINE set to an earlier output, fails when lines/s of a project
+# dropped by more than BENCH_THRESHOLD percent (15 by default).
+
+set -e
+
+OUTPUT="${1:-build/bench_compile.json}"
+THRESHOLD="${BENCH_THRESHOLD:-15}"
+RUNS="${BENCH_RUNS:-3}"
+PENQUIN="${PENQUIN:-$(pwd)/build/penquin}"
+CORPUS="$(pwd)/build/bench_corpus"
+
+# name modules functions statements fanout depth
+PROJECTS="base 8 8 16 2 4
+modules 64 8 16 2 4
+functions 8 64 16 2 4
+statements 8 8 128 2 4
+fanout 64 8 16 16 4
+depth 8 8 16 2 32"
+
+mkdir -p "$CORPUS"
+gcc -std=c11 -O2 -Wall -o build/bench_corpus_gen bench/corpus.c
+
+echo "$PROJECTS" | {
+	first=1
+	echo "[" > "$OUTPUT"
+	while read -r name modules functions statements fanout depth; do
+		dir="$CORPUS/$name"
+		rm -rf "$dir"
+		build/bench_corpus_gen "$dir" "$modules" "$functions" "$statements" "$fanout" "$depth"
+		lines=$(cat "$dir"/*.pq | wc -l)
+
+		# Best of the runs, the phases and RSS are from the best one
+		best=""
+		for run in $(seq "$RUNS"); do
+			start=$(date +%s%N)
+			(cd "$dir" && "$PENQUIN" --time-report --mem-report main.pq > /dev/null 2> report.txt)
+			wall=$(( ($(date +%s%N) - start) / 1000 ))
+			if [ -z "$best" ] || [ "$wall" -lt "$best" ]; then
+				best=$wall
+				cp "$dir/report.txt" "$dir/best.txt"
+			fi
+		done
+
+		# Phase names like "link std" have spaces, the name is the first 16
+		# columns of the report
+		phases=$(awk '/^phase +count/ { table = 1; next } table && NF == 0 { exit } table {
+			phase = substr($0, 1, 16)
+			sub(/ +$/, "", phase)
+			split(substr($0, 17), columns, " ")
+			printf "%s\"%s\": %s", (count++ ? ", " : ""), phase, columns[2]
+		}' "$dir/best.txt")
+		rss=$(awk '$1 == "peak" && $2 == "rss" { print $3 }' "$dir/best.txt")
+		rate=$(awk -v lines="$lines" -v wall="$best" 'BEGIN { printf "%.0f", lines / (wall / 1e6) }')
+
+		printf "%-12s %6d lines %10.3f ms %10d lines/s %8d KiB\n" "$name" "$lines" "$(awk -v wall="$best" 'BEGIN { print wall / 1e3 }')" "$rate" $((rss / 1024))
+		[ "$first" = 1 ] || echo "," >> "$OUTPUT"
+		first=0
+		printf '  {"name": "%s", "modules": %d, "functions": %d, "statements": %d, "fanout": %d, "depth": %d, "lines": %d, "wall_us": %d, "lines_per_sec": %d, "peak_rss": %d, "phases_ms": {%s}}' \
+			"$name" "$modules" "$functions" "$statements" "$fanout" "$depth" "$lines" "$best" "$rate" "$rss" "$phases" >> "$OUTPUT"
+	done
+	printf "\n]\n" >> "$OUTPUT"
+}
+
+if [ -z "$BENCH_BASELINE" ]; then
+	exit 0
+fi
+
+# One project per line, so the lines/s of a project can be found by name
+awk -v threshold="$THRESHOLD" '
+	function field(line, key) {
+		match(line, "\"" key "\": [^,}]*")
+		value = substr(line, RSTART, RLENGTH)
+		sub(/.*: /, "", value)
+		gsub(/"/, "", value)
+		return value
+	}
+	FNR == NR && /"name"/ { baseline[field($0, "name")] = field($0, "lines_per_sec"); next }
+	/"name"/ {
+		name = field($0, "name")
+		rate = field($0, "lines_per_sec")
+		if (!(name in baseline)) {
+			next
+		}
+		change = (rate - baseline[name]) * 100 / baseline[name]
+		printf "%-12s %10d lines/s %+7.1f%% against baseline\n", name, rate, change
+		if (change < -threshold) {
+			printf "%s regressed by more than %d%%\n", name, threshold > "/dev/stderr"
+			failed = 1
+		}
+	}
+	END { exit failed }
+' "$BENCH_BASELINE" "$OUTPUT"
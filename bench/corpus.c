@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+typedef struct {
+	int modules;
+	int functions;  // per module
+	int statements; // per function
+	int fanout;     // imports per module
+	int depth;      // operators per expression
+} Shape;
+
+static unsigned int seed = 1;
+
+static int next_random() {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+// An operand is the parameter, an earlier local or a constant
+static void write_operand(FILE *file, int locals) {
+	int choice = next_random() % 3;
+	if (choice == 0 || (choice == 1 && locals == 0)) {
+		fprintf(file, "a");
+	} else if (choice == 1) {
+		fprintf(file, "v%d", next_random() % locals);
+	} else {
+		fprintf(file, "%d", next_random() % 100);
+	}
+}
+
+// The parser has no grouping, so depth is the number of operators in a chain
+// that precedence turns into a tree
+static void write_expression(FILE *file, int depth, int locals) {
+	static char operators[] = "+-*";
+	write_operand(file, locals);
+	for (int i = 0; i < depth; i++) {
+		fprintf(file, " %c ", operators[next_random() % 3]);
+		write_operand(file, locals);
+	}
+}
+
+// Statements cycle through assignments, branches and calls, the calls go to
+// the previous function or to an import
+static void write_function(FILE *file, Shape *shape, int module, int function) {
+	fprintf(file, "fun f%d(a: s4): s4 {\n", function);
+	for (int i = 0; i < shape->statements; i++) {
+		int imports = module < shape->fanout ? module : shape->fanout;
+		switch (i % 4) {
+			case 2:
+				fprintf(file, "\tv%d = 0;\n\tif v%d > a {\n\t\tv%d = ", i, i - 1, i);
+				write_expression(file, shape->depth, i);
+				fprintf(file, ";\n\t}\n");
+				break;
+			case 3:
+				if (function > 0) {
+					fprintf(file, "\tv%d = f%d(v%d);\n", i, function - 1, i - 1);
+				} else if (imports > 0) {
+					int import = module - 1 - next_random() % imports;
+					fprintf(file, "\tv%d = m%d::f%d(v%d);\n", i, import, next_random() % shape->functions, i - 1);
+				} else {
+					fprintf(file, "\tv%d = v%d;\n", i, i - 1);
+				}
+				break;
+			default:
+				fprintf(file, "\tv%d = ", i);
+				write_expression(file, shape->depth, i);
+				fprintf(file, ";\n");
+		}
+	}
+	if (shape->statements > 0) {
+		fprintf(file, "\treturn v%d;\n}\n\n", shape->statements - 1);
+	} else {
+		fprintf(file, "\treturn a;\n}\n\n");
+	}
+}
+
+static FILE *create_file(char *dir, char *name) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s.pq", dir, name);
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Unable to create %s\n", path);
+		exit(1);
+	}
+	return file;
+}
+
+// Usage: bench_corpus dir modules functions statements fanout depth
+// Writes modules m0.pq to mN.pq into dir, each importing the fanout modules
+// before it, and main.pq importing the last ones.
+int main(int argc, char **argv) {
+	if (argc != 7) {
+		fprintf(stderr, "Usage: bench_corpus dir modules functions statements fanout depth\n");
+		return 1;
+	}
+	char *dir = argv[1];
+	Shape shape = {
+		.modules = atoi(argv[2]),
+		.functions = atoi(argv[3]),
+		.statements = atoi(argv[4]),
+		.fanout = atoi(argv[5]),
+		.depth = atoi(argv[6]),
+	};
+	if (shape.modules < 1 || shape.functions < 1 || shape.statements < 0 || shape.fanout < 0 || shape.depth < 0) {
+		fprintf(stderr, "Invalid corpus shape\n");
+		return 1;
+	}
+	mkdir(dir, 0755);
+
+	char name[32];
+	for (int module = 0; module < shape.modules; module++) {
+		sprintf(name, "m%d", module);
+		FILE *file = create_file(dir, name);
+		for (int i = 1; i <= shape.fanout && i <= module; i++) {
+			fprintf(file, "import \"m%d\"\n", module - i);
+		}
+		fprintf(file, "\n");
+		for (int function = 0; function < shape.functions; function++) {
+			write_function(file, &shape, module, function);
+		}
+		fclose(file);
+	}
+
+	FILE *file = create_file(dir, "main");
+	int imports = shape.fanout > 0 ? shape.fanout : 1;
+	for (int i = 1; i <= imports && i <= shape.modules; i++) {
+		fprintf(file, "import \"m%d\"\n", shape.modules - i);
+	}
+	// The calls fan out exponentially, compiling test also runs it
+	fprintf(file, "\nfun main(): s4 {\n\tn = 0;\n\tif n > 0 {\n");
+	for (int i = 1; i <= imports && i <= shape.modules; i++) {
+		fprintf(file, "\t\tm%d::f%d(%d);\n", shape.modules - i, shape.functions - 1, i);
+	}
+	fprintf(file, "\t}\n\treturn 0;\n}\n");
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+	double wall;
+	long long instructions; // -1 when perf events aren't available
+	long max_rss;           // KiB
+} Sample;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Counts the user space instructions of pid from its exec on
+static int open_counter(pid_t pid) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.enable_on_exec = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+}
+
+// Runs the binary once with its output discarded. The child waits for the
+// counter to be attached before it execs.
+static Sample run(char **argv) {
+	int ready[2];
+	if (pipe(ready) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+	double start = now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		char byte;
+		close(ready[1]);
+		if (read(ready[0], &byte, 1) != 1) {
+			_exit(1);
+		}
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		execv(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+	close(ready[0]);
+	int counter = open_counter(pid);
+	if (write(ready[1], "x", 1) != 1) {
+		perror("write");
+		exit(1);
+	}
+	close(ready[1]);
+
+	int status;
+	struct rusage usage;
+	wait4(pid, &status, 0, &usage);
+	Sample sample = { .wall = now() - start, .instructions = -1, .max_rss = usage.ru_maxrss };
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+		fprintf(stderr, "%s failed\n", argv[0]);
+		exit(1);
+	}
+	if (counter >= 0) {
+		uint64_t count;
+		if (read(counter, &count, sizeof(count)) == sizeof(count)) {
+			sample.instructions = count;
+		}
+		close(counter);
+	}
+	return sample;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(double *)a, y = *(double *)b;
+	return (x > y) - (x < y);
+}
+
+// Usage: bench_measure warmup runs binary [args...]
+// Prints the median and p99 wall time in ms, the median instruction count
+// and the max RSS in KiB of the runs after warmup.
+int main(int argc, char **argv) {
+	if (argc < 4) {
+		fprintf(stderr, "Usage: bench_measure warmup runs binary [args...]\n");
+		return 1;
+	}
+	int warmup = atoi(argv[1]);
+	int runs = atoi(argv[2]);
+	if (warmup < 0 || runs < 1) {
+		fprintf(stderr, "Invalid number of runs\n");
+		return 1;
+	}
+
+	for (int i = 0; i < warmup; i++) {
+		run(argv + 3);
+	}
+	double *walls = malloc(sizeof(double) * runs);
+	double *instructions = malloc(sizeof(double) * runs);
+	long max_rss = 0;
+	for (int i = 0; i < runs; i++) {
+		Sample sample = run(argv + 3);
+		walls[i] = sample.wall;
+		instructions[i] = sample.instructions;
+		if (sample.max_rss > max_rss) {
+			max_rss = sample.max_rss;
+		}
+	}
+	qsort(walls, runs, sizeof(double), compare_doubles);
+	qsort(instructions, runs, sizeof(double), compare_doubles);
+
+	int p99 = (runs * 99 + 99) / 100 - 1;
+	printf("%.3f %.3f %.0f %ld\n", walls[runs / 2] * 1e3, walls[p99] * 1e3, instructions[runs / 2], max_rss);
+	free(walls);
+	free(instructions);
+	return 0;
+}
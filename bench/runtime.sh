@@ -0,0 +1,59 @@
+#!/bin/sh
+
+# Usage: bench/runtime.sh [output.json]
+# Builds each workload in bench/runtime with build/penquin PENQUIN_FLAGS
+# (-O2 by default) and its C equivalent with clang -O2, then runs both
+# BENCH_WARMUP times to warm up and BENCH_RUNS times measured. Writes the
+# median and p99 wall time, the instructions and the max RSS of each to
+# output.json.
+
+set -e
+
+OUTPUT="${1:-build/bench_runtime.json}"
+WARMUP="${BENCH_WARMUP:-2}"
+RUNS="${BENCH_RUNS:-10}"
+PENQUIN="${PENQUIN:-$(pwd)/build/penquin}"
+PENQUIN_FLAGS="${PENQUIN_FLAGS:--O2}"
+CC="${BENCH_CC:-clang}"
+DIR="build/bench_runtime"
+
+if ! command -v "$CC" > /dev/null; then
+	echo "$CC not found, building the C workloads with cc"
+	CC=cc
+fi
+
+mkdir -p "$DIR"
+gcc -std=c11 -O2 -Wall -o build/bench_measure bench/measure.c
+
+# The workloads run from the root to find their files
+printf "%-8s %12s %12s %14s %10s   %12s %12s %14s %10s %8s\n" workload "pq median" "pq p99" "pq instr" "pq KiB" "c median" "c p99" "c instr" "c KiB" "pq/c"
+echo "[" > "$OUTPUT"
+first=1
+for source in bench/runtime/*.pq; do
+	name=$(basename "$source" .pq)
+	if ! "$PENQUIN" $PENQUIN_FLAGS --output="$DIR/$name-pq" "$source" > "$DIR/$name.log" 2>&1; then
+		cat "$DIR/$name.log" >&2
+		echo "unable to compile $source" >&2
+		exit 1
+	fi
+	"$CC" -O2 -o "$DIR/$name-c" "bench/runtime/$name.c"
+
+	result=$(build/bench_measure "$WARMUP" "$RUNS" "$DIR/$name-pq")
+	set -- $result
+	pq_median=$1 pq_p99=$2 pq_instructions=$3 pq_rss=$4
+	result=$(build/bench_measure "$WARMUP" "$RUNS" "$DIR/$name-c")
+	set -- $result
+	c_median=$1 c_p99=$2 c_instructions=$3 c_rss=$4
+	# null when perf events aren't available
+	[ "$pq_instructions" != -1 ] || pq_instructions=null
+	[ "$c_instructions" != -1 ] || c_instructions=null
+	ratio=$(awk -v pq="$pq_median" -v c="$c_median" 'BEGIN { printf "%.2f", pq / c }')
+
+	printf "%-8s %10s ms %10s ms %14s %10s   %10s ms %10s ms %14s %10s %7sx\n" "$name" \
+		"$pq_median" "$pq_p99" "$pq_instructions" "$pq_rss" "$c_median" "$c_p99" "$c_instructions" "$c_rss" "$ratio"
+	[ "$first" = 1 ] || echo "," >> "$OUTPUT"
+	first=0
+	printf '  {"name": "%s", "penquin": {"median_ms": %s, "p99_ms": %s, "instructions": %s, "max_rss_kib": %s}, "c": {"median_ms": %s, "p99_ms": %s, "instructions": %s, "max_rss_kib": %s}, "ratio": %s}' \
+		"$name" "$pq_median" "$pq_p99" "$pq_instructions" "$pq_rss" "$c_median" "$c_p99" "$c_instructions" "$c_rss" "$ratio" >> "$OUTPUT"
+done
+printf "\n]\n" >> "$OUTPUT"
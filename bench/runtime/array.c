@@ -0,0 +1,16 @@
+#include <stdio.h>
+
+int main() {
+	int numbers[] = {83, 3, 9, 10, 8, 41, 7, 2, 66, 5, 12, 90, 1, 38, 24, 17};
+	int sum = 0;
+	int j = 0;
+	for (int i = 0; i < 50000000; i++) {
+		sum = sum + numbers[j];
+		j = j + 1;
+		if (j == 16) {
+			j = 0;
+		}
+	}
+	printf("%d\n", sum);
+	return 0;
+}
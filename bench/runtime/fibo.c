@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+static int fib(int n) {
+	if (n <= 1) {
+		return n;
+	}
+	return fib(n - 2) + fib(n - 1);
+}
+
+int main() {
+	printf("%d\n", fib(32));
+	return 0;
+}
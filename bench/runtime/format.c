@@ -0,0 +1,8 @@
+#include <stdio.h>
+
+int main() {
+	for (int i = 0; i < 200000; i++) {
+		printf("line %d of %s\n", i, "format");
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int main() {
+	char buf[2000 * 4] = {0};
+	for (int i = 0; i < 100000; i++) {
+		int fd = open("bench/runtime/read.pq", O_RDONLY);
+		read(fd, buf, 2000);
+		close(fd);
+	}
+	puts(buf);
+	return 0;
+}
@@ -0,0 +1,71 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../common.h"
+#include "../token.h"
+
+#define CORPUS_SIZE (64 << 20)
+#define RUNS 5
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Usage: bench_scan [min MB/s] files...
+// Scans the files repeated into a 64 MiB corpus and fails when the best
+// run is below the given throughput.
+int main(int argc, char **argv) {
+	double target = argc > 1 ? atof(argv[1]) : 0;
+	if (argc < 3) {
+		fprintf(stderr, "Usage: bench_scan min_mbps file...\n");
+		return 1;
+	}
+
+	char *corpus = malloc(CORPUS_SIZE + 1);
+	size_t size = 0;
+	for (int i = 2; i < argc && size < CORPUS_SIZE; i++) {
+		char *data;
+		size_t file_size = read_file_from_path(argv[i], &data);
+		size_t length = file_size;
+		if (size + length > CORPUS_SIZE) {
+			length = CORPUS_SIZE - size;
+		}
+		memcpy(corpus + size, data, length);
+		size += length;
+		release_file(data, file_size);
+	}
+	for (size_t length = size; size > 0 && size < CORPUS_SIZE; size += length) {
+		if (size + length > CORPUS_SIZE) {
+			length = CORPUS_SIZE - size;
+		}
+		memcpy(corpus + size, corpus, length);
+	}
+	corpus[size] = '\0';
+
+	double best = 0;
+	int tokens = 0;
+	for (int run = 0; run < RUNS; run++) {
+		TokenStream stream;
+		token_stream_init(&stream, corpus);
+		tokens = 0;
+		double start = now();
+		while (token_next(&stream).type != TOKEN_EOF) {
+			tokens++;
+		}
+		double mbps = size / (now() - start) / (1 << 20);
+		if (mbps > best) {
+			best = mbps;
+		}
+	}
+
+	printf("scan     %8.1f MB/s %10d tokens in %zu bytes\n", best, tokens, size);
+	if (best < target) {
+		fprintf(stderr, "scan throughput below target of %.1f MB/s\n", target);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../table.h"
+
+#define DEFAULT_N 1000000
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double start, int n) {
+	double elapsed = now() - start;
+	printf("%-8s %8.1f ns/op %10.0f ops/s\n", name, elapsed * 1e9 / n, n / elapsed);
+}
+
+int main(int argc, char **argv) {
+	int n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+
+	// Keys look like the module qualified names the resolver uses
+	String *keys = malloc(sizeof(String) * n);
+	String *misses = malloc(sizeof(String) * n);
+	for (int i = 0; i < n; i++) {
+		keys[i].p = malloc(48);
+		keys[i].length = sprintf(keys[i].p, "./res/some/module/path.pq@name_%d", i);
+		misses[i].p = malloc(48);
+		misses[i].length = sprintf(misses[i].p, "./res/some/module/path.pq@miss_%d", i);
+	}
+
+	Table table;
+	table_init(&table);
+
+	double start = now();
+	for (int i = 0; i < n; i++) {
+		table_put(&table, keys[i], keys + i);
+	}
+	report("put", start, n);
+
+	start = now();
+	long found = 0;
+	for (int i = 0; i < n; i++) {
+		found += table_get(&table, keys[(i * 7919L) % n]) != NULL;
+	}
+	report("get", start, n);
+
+	start = now();
+	for (int i = 0; i < n; i++) {
+		found += table_get(&table, misses[i]) != NULL;
+	}
+	report("miss", start, n);
+
+	start = now();
+	for (int i = 0; i < n; i += 2) {
+		table_remove(&table, keys[i]);
+	}
+	report("remove", start, n / 2);
+
+	start = now();
+	TableEntry *entry;
+	int iterated = 0;
+	for (int i = 0; table_next(&table, &i, &entry);) {
+		iterated++;
+	}
+	report("iterate", start, iterated);
+
+	if (found != n || iterated != table.length) {
+		fprintf(stderr, "table bench: inconsistent results\n");
+		return 1;
+	}
+	table_free(&table);
+	return 0;
+}
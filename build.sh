@@ -2,7 +2,47 @@
 
 set -e
 
-gcc -std=c11 -g -O0 -Wall\
+# libpenquin, everything but the command line driver
+SOURCES="arena.c fail.c list.c token.c parser.c codegen.c table.c string.c file.c resolver.c symbol.c type.c typechecker.c pool.c memory.c module.c cache.c interface.c std.c jit.c repl.c timing.c penquin.c"
+CFLAGS="-std=c11 -g -O0 -Wall -pthread"
+
+# Stage one has no std embedded, it compiles std from source into the
+# bitcode and interfaces embedded in the real compiler
+mkdir -p build/std
+printf '#include "../std.h"\n\nStdModule std_modules[] = {{NULL}};\n' > build/std_modules.c
+gcc $CFLAGS\
+	-o build/penquin-stage1\
+	main.c $SOURCES build/std_modules.c\
+	-lLLVM
+
+STD_DIR="$(pwd)/build/std"
+{
+	printf '#include "../std.h"\n\n__asm__(".section .rodata\\n"\n'
+	for source in std/*.pq; do
+		name=$(basename "$source" .pq)
+		build/penquin-stage1 --emit-std=build/std "$source" >&2
+		printf '\t".balign 16\\nstd_%s_interface: .incbin \\"%s/%s.pqi\\"\\nstd_%s_interface_end:\\n"\n' "$name" "$STD_DIR" "$name" "$name"
+		printf '\t".balign 16\\nstd_%s_bitcode: .incbin \\"%s/%s.bc\\"\\nstd_%s_bitcode_end:\\n"\n' "$name" "$STD_DIR" "$name" "$name"
+	done
+	printf '\t".previous\\n");\n\n'
+	for source in std/*.pq; do
+		name=$(basename "$source" .pq)
+		printf 'extern char std_%s_interface[], std_%s_interface_end[], std_%s_bitcode[], std_%s_bitcode_end[];\n' "$name" "$name" "$name" "$name"
+	done
+	printf '\nStdModule std_modules[] = {\n'
+	for source in std/*.pq; do
+		name=$(basename "$source" .pq)
+		printf '\t{"std:%s", std_%s_interface, std_%s_interface_end, std_%s_bitcode, std_%s_bitcode_end},\n' "$name" "$name" "$name" "$name" "$name"
+	done
+	printf '\t{NULL},\n};\n'
+} > build/std_modules.c
+
+gcc $CFLAGS -fPIC -shared\
+	-o build/libpenquin.so\
+	$SOURCES build/std_modules.c\
+	-lLLVM
+
+gcc $CFLAGS\
 	-o build/penquin\
-	-lLLVM\
-	main.c list.c token.c parser.c codegen.c table.c string.c file.c resolver.c typechecker.c
+	main.c $SOURCES build/std_modules.c\
+	-lLLVM
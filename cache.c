@@ -0,0 +1,170 @@
+#define _DEFAULT_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "cache.h"
+#include "common.h"
+#include "penquin.h"
+
+#define FNV_OFFSET (((unsigned __int128)0x6c62272e07bb0142 << 64) | 0x62b821756295c58d)
+#define FNV_PRIME  (((unsigned __int128)0x0000000001000000 << 64) | 0x000000000000013b)
+
+typedef struct {
+	char *name;
+	off_t size;
+	time_t used;
+} CacheEntry;
+
+void hash_init(Hash *hash) {
+	hash->value = FNV_OFFSET;
+}
+
+void hash_update(Hash *hash, const void *data, size_t size) {
+	const unsigned char *bytes = data;
+	unsigned __int128 value = hash->value;
+	for (size_t i = 0; i < size; i++) {
+		value ^= bytes[i];
+		value *= FNV_PRIME;
+	}
+	hash->value = value;
+}
+
+static void make_directory(char *dir) {
+	char *path = cstring_duplicate(dir);
+	for (char *p = path + 1; *p != '\0'; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			mkdir(path, 0755);
+			*p = '/';
+		}
+	}
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Epic fail, unable to create cache directory %s\n", dir);
+		exit(1);
+	}
+	free(path);
+}
+
+// Options are whatever changes the object of an unchanged module, the
+// compiler itself included
+void cache_initialize(Cache *cache, char *dir, size_t limit, char *options) {
+	make_directory(dir);
+	cache->dir = cstring_duplicate(dir);
+	cache->limit = limit;
+	hash_init(&cache->options);
+	char *version = PENQUIN_VERSION " " __DATE__ " " __TIME__;
+	hash_update(&cache->options, version, strlen(version) + 1);
+	hash_update(&cache->options, options, strlen(options) + 1);
+	pthread_mutex_init(&cache->lock, NULL);
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+void cache_free(Cache *cache) {
+	free(cache->dir);
+	pthread_mutex_destroy(&cache->lock);
+}
+
+// Path of the entry for key, suffix tells the kinds of entries apart
+char *cache_path(Cache *cache, Hash key, char *suffix) {
+	Hash hash = cache->options;
+	hash_update(&hash, &key, sizeof(key));
+
+	char *path = malloc(strlen(cache->dir) + 1 + 32 + strlen(suffix) + 1);
+	int n = sprintf(path, "%s/", cache->dir);
+	for (int i = 0; i < 16; i++) {
+		n += sprintf(path + n, "%02x", (unsigned char)(hash.value >> (8 * i)));
+	}
+	strcpy(path + n, suffix);
+	return path;
+}
+
+// Marks the entry at path as recently used, false if there is none
+bool cache_touch(char *path) {
+	return utimes(path, NULL) == 0;
+}
+
+// Returns the path the object for key is stored at and counts the hit or
+// miss
+char *cache_lookup(Cache *cache, Hash key, bool *hit) {
+	char *path = cache_path(cache, key, ".o");
+	*hit = cache_touch(path);
+	pthread_mutex_lock(&cache->lock);
+	if (*hit) {
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return path;
+}
+
+// Entries are written next to where they are stored and renamed into place,
+// so other compilations never see half written ones
+char *cache_temporary(char *path) {
+	char *temporary = malloc(strlen(path) + 48);
+	sprintf(temporary, "%s.%d.%lx.tmp", path, (int)getpid(), (unsigned long)pthread_self());
+	return temporary;
+}
+
+void cache_store(char *temporary, char *path) {
+	if (rename(temporary, path) != 0) {
+		fprintf(stderr, "Epic fail, unable to store %s in the cache\n", temporary);
+		exit(1);
+	}
+}
+
+static int compare_used(const void *a, const void *b) {
+	const CacheEntry *x = a;
+	const CacheEntry *y = b;
+	return (x->used > y->used) - (x->used < y->used);
+}
+
+void cache_evict(Cache *cache) {
+	DIR *dir = opendir(cache->dir);
+	if (dir == NULL) {
+		return;
+	}
+
+	int length = 0;
+	int capacity = 64;
+	CacheEntry *entries = malloc(sizeof(CacheEntry) * capacity);
+	size_t total = 0;
+	size_t dir_length = strlen(cache->dir);
+	struct dirent *dirent;
+	while ((dirent = readdir(dir)) != NULL) {
+		char *suffix = strrchr(dirent->d_name, '.');
+		if (suffix == NULL || (strcmp(suffix, ".o") != 0 && strcmp(suffix, ".pqi") != 0 && strcmp(suffix, ".refs") != 0)) {
+			continue;
+		}
+		size_t name_length = strlen(dirent->d_name);
+		char *name = malloc(dir_length + 1 + name_length + 1);
+		sprintf(name, "%s/%s", cache->dir, dirent->d_name);
+		struct stat st;
+		if (stat(name, &st) != 0) {
+			free(name);
+			continue;
+		}
+		if (length == capacity) {
+			capacity *= 2;
+			entries = realloc(entries, sizeof(CacheEntry) * capacity);
+		}
+		entries[length++] = (CacheEntry) { name, st.st_size, st.st_mtime };
+		total += st.st_size;
+	}
+	closedir(dir);
+
+	qsort(entries, length, sizeof(CacheEntry), compare_used);
+	for (int i = 0; i < length; i++) {
+		if (total > cache->limit && unlink(entries[i].name) == 0) {
+			total -= entries[i].size;
+		}
+		free(entries[i].name);
+	}
+	free(entries);
+}
@@ -0,0 +1,38 @@
+#ifndef PENQUIN_CACHE_H
+#define PENQUIN_CACHE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 128 bit FNV-1a, cache keys are content addresses so 64 bits is too few
+typedef struct {
+	unsigned __int128 value;
+} Hash;
+
+// On disk cache of module objects, their references and interfaces keyed by a
+// hash of everything they depend on, evicted least recently used first once
+// it grows past limit
+typedef struct {
+	char *dir;
+	size_t limit;
+	Hash options;
+	pthread_mutex_t lock;
+	int hits;
+	int misses;
+} Cache;
+
+void  hash_init(Hash *hash);
+void  hash_update(Hash *hash, const void *data, size_t size);
+
+void  cache_evict(Cache *cache);
+void  cache_free(Cache *cache);
+void  cache_initialize(Cache *cache, char *dir, size_t limit, char *options);
+char *cache_lookup(Cache *cache, Hash key, bool *hit);
+char *cache_path(Cache *cache, Hash key, char *suffix);
+void  cache_store(char *temporary, char *path);
+char *cache_temporary(char *path);
+bool  cache_touch(char *path);
+
+#endif
@@ -1,54 +1,82 @@
 #include <assert.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <llvm-c/Analysis.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/Object.h>
 #include <llvm-c/TargetMachine.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 #include "codegen.h"
 #include "common.h"
+#include "compilation.h"
 #include "list.h"
 #include "parser.h"
 #include "table.h"
 #include "token.h"
+#include "type.h"
+
+// State of generating one module. Every module gets its own LLVM context
+// so modules are generated and emitted on several threads.
+typedef struct {
+	LLVMContextRef context;
+	LLVMTypeRef *types; // by type id
+	LLVMBuilderRef builder;
+	LLVMBuilderRef entry; // at the end of the allocas of the current function
+	LLVMModuleRef module;
+	LLVMValueRef current_function;
+	List rest_allocas;    // RestAlloca, shared by the calls in the current function
+	Timings *timings;
+	char *name;
+} Codegen;
+
+// Memory for the rest arguments of calls, slot -1 is the array and the
+// others hold the values any items point to
+typedef struct {
+	LLVMTypeRef type;
+	int slot;
+	LLVMValueRef alloca;
+} RestAlloca;
+
+// Allocas all go in the entry block, so they are allocated once per call
+// however often a loop runs them and mem2reg can promote them
+static LLVMValueRef build_entry_alloca(Codegen *codegen, LLVMTypeRef type, const char *name) {
+	return LLVMBuildAlloca(codegen->entry, type, name);
+}
 
-static LLVMContextRef context;
-static LLVMBuilderRef builder;
-static LLVMModuleRef module;
-static LLVMValueRef current_function;
-static Table types;
-static char *module_path;
-
-static char *resolve_identifier_name(char *path, String name) {
-	int plen = strlen(path);
-	char prefix[plen + 2];
-	memcpy(prefix, path, plen);
-	prefix[plen] = '@';
-	prefix[plen + 1] = '\0';
-	return cstring_concat_String(prefix, name);
-}
-
-static char *resolve_identifier(String name, bool external) {
-	if (external || String_cmp_cstring(name, "main") == 0) {
-		return String_to_cstring(name);
-	} else {
-		return resolve_identifier_name(module_path, name);
+// Rest arguments only live during the call, so calls passing the same
+// type share their memory
+static LLVMValueRef rest_alloca(Codegen *codegen, LLVMTypeRef type, int slot) {
+	for (int i = 0; i < codegen->rest_allocas.length; i++) {
+		RestAlloca *rest = &LIST_GET(RestAlloca, &codegen->rest_allocas, i);
+		if (rest->type == type && rest->slot == slot) {
+			return rest->alloca;
+		}
 	}
+	RestAlloca rest = {
+		.type = type,
+		.slot = slot,
+		.alloca = build_entry_alloca(codegen, type, slot < 0 ? "rest" : "rest.value"),
+	};
+	list_add(&codegen->rest_allocas, &rest);
+	return rest.alloca;
 }
 
-static LLVMValueRef handle_rvalue(LLVMValueRef rvalue) {
+static LLVMValueRef handle_rvalue(Codegen *codegen, LLVMValueRef rvalue) {
 	LLVMValueKind kind = LLVMGetValueKind(rvalue);
-	if (kind == LLVMInstructionValueKind && LLVMGetInstructionOpcode(rvalue) == LLVMAlloca) {
-		LLVMTypeRef allocated_type = LLVMGetAllocatedType(rvalue);
+	bool alloca = kind == LLVMInstructionValueKind && LLVMGetInstructionOpcode(rvalue) == LLVMAlloca;
+	if (alloca || kind == LLVMGlobalVariableValueKind) {
+		LLVMTypeRef allocated_type = alloca ? LLVMGetAllocatedType(rvalue) : LLVMGlobalGetValueType(rvalue);
 		LLVMTypeKind allocated_kind = LLVMGetTypeKind(allocated_type);
 		if (allocated_kind == LLVMArrayTypeKind) {
 			return rvalue;
 		}
 
 		return LLVMBuildLoad2(
-			builder,
+			codegen->builder,
 			allocated_type,
 			rvalue,
 			""
@@ -57,81 +85,72 @@ static LLVMValueRef handle_rvalue(LLVMValueRef rvalue) {
 	return rvalue;
 }
 
-// TODO: attach actual id to types
 static int get_type_id(TypeInfo *type_info) {
-	if (type_info->type == TYPE_VALUE) {
-		if (String_cmp_cstring(type_info->value_of, "s1") == 0) {
-			return 0;
-		} else if (String_cmp_cstring(type_info->value_of, "s2") == 0) {
-			return 1;
-		} else if (String_cmp_cstring(type_info->value_of, "s4") == 0) {
-			return 2;
-		} else if (String_cmp_cstring(type_info->value_of, "s8") == 0) {
-			return 3;
-		} else if (String_cmp_cstring(type_info->value_of, "bool") == 0) {
-			return 4;
-		}
-		assert(false);
-	} else if (type_info->type == TYPE_POINTER) {
-		return 100 + get_type_id(type_info->pointer_to);
-	} else if (type_info->type == TYPE_ARRAY) {
-		return 1000 + get_type_id(type_info->array.of);
-	}
-	assert(false);
+	return type_info->tag;
 }
 
-static LLVMTypeRef parse_type(TypeInfo *type_info) {
+// LLVM types belong to a context, so they are cached per module by type
+// id. Value types are set up in initialize_types.
+static LLVMTypeRef parse_type(Codegen *codegen, TypeInfo *type_info) {
+	LLVMTypeRef *type = &codegen->types[type_info->id];
+	if (*type != NULL) {
+		return *type;
+	}
 	switch (type_info->type) {
-		case TYPE_VALUE:
-			return table_get(&types, type_info->value_of);
 		case TYPE_ARRAY:
-			return LLVMArrayType2(parse_type(type_info->array.of), type_info->array.length);
+			*type = LLVMArrayType2(parse_type(codegen, type_info->array.of), type_info->array.length);
+			break;
 		case TYPE_POINTER:
-			return LLVMPointerType(parse_type(type_info->pointer_to), 0);
+			*type = LLVMPointerType(parse_type(codegen, type_info->pointer_to), 0);
+			break;
 		default:
-			return NULL;
+			break;
 	}
+	return *type;
 }
 
-static LLVMValueRef parse_node(AstNode *node);
+static LLVMValueRef parse_node(Codegen *codegen, AstNode *node);
+static LLVMValueRef parse_function_definition(Codegen *codegen, char *name, AstNode *node);
 
 static void report_invalid_node(const char *message) {
     fprintf(stderr, "[CODEGEN] %s", message);
-    exit(1);
+    fail();
 }
 
-static LLVMValueRef parse_number(AstNode *node) {
+static LLVMValueRef parse_number(Codegen *codegen, AstNode *node) {
     if (node->type != AST_NUMBER) {
         report_invalid_node("Expected number");
     }
-    LLVMTypeRef int_type = LLVMInt32TypeInContext(context);
+    LLVMTypeRef int_type = LLVMInt32TypeInContext(codegen->context);
     return LLVMConstInt(int_type, node->as.number, 1);
 }
 
-static LLVMValueRef parse_string(AstNode *node) {
+static LLVMValueRef parse_string(Codegen *codegen, AstNode *node) {
     if (node->type != AST_STRING) {
         report_invalid_node("Expected string");
     }
 
 	char *cstring = String_to_cstring(node->as.string);
-	return LLVMBuildGlobalString(builder, cstring, "");
+	return LLVMBuildGlobalString(codegen->builder, cstring, "");
 }
 
 static int score_value_type(TypeInfo *type) {
-	if (String_cmp_cstring(type->value_of, "bool")) {
-		return 1;
-	} else if (String_cmp_cstring(type->value_of, "s1")) {
-		return 2;
-	} else if (String_cmp_cstring(type->value_of, "s2")) {
-		return 3;
-	} else if (String_cmp_cstring(type->value_of, "s4")) {
-		return 4;
-	} else if (String_cmp_cstring(type->value_of, "s8")) {
-		return 5;
-	} else {
-		char *type_name = String_to_cstring(type->value_of);
-		fprintf(stderr, "Cannot score type: %s\n", type_name);
-		exit(1);
+	switch (type->tag) {
+		case TYPE_TAG_BOOL:
+			return 1;
+		case TYPE_TAG_S1:
+			return 2;
+		case TYPE_TAG_S2:
+			return 3;
+		case TYPE_TAG_S4:
+			return 4;
+		case TYPE_TAG_S8:
+			return 5;
+		default: {
+			DEFINE_CSTRING(type_name, type->value_of);
+			fprintf(stderr, "Cannot score type: %s\n", type_name);
+			fail();
+		}
 	}
 }
 
@@ -144,9 +163,65 @@ static TypeInfo *deduce_type(AstNode *left, AstNode *right) {
 	return right->type_info;
 }
 
-static LLVMValueRef parse_operator(AstNode *node) {
-	LLVMValueRef left = handle_rvalue(parse_node(node->as.operator_.left));
-	LLVMValueRef right = handle_rvalue(parse_node(node->as.operator_.right));
+static bool is_logical(AstNode *node) {
+	return node->type == AST_OPERATOR &&
+		(node->as.operator_.type == TOKEN_LOGICAL_AND || node->as.operator_.type == TOKEN_LOGICAL_OR);
+}
+
+// Branches to true_block when condition isn't zero. The right side of && and
+// || is only evaluated when the left doesn't decide, without an i1 for the
+// operator itself.
+static void build_condition(Codegen *codegen, AstNode *condition, LLVMBasicBlockRef true_block, LLVMBasicBlockRef false_block) {
+	if (is_logical(condition)) {
+		LLVMBasicBlockRef right_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "logical.rhs");
+		if (condition->as.operator_.type == TOKEN_LOGICAL_AND) {
+			build_condition(codegen, condition->as.operator_.left, right_block, false_block);
+		} else {
+			build_condition(codegen, condition->as.operator_.left, true_block, right_block);
+		}
+		LLVMPositionBuilderAtEnd(codegen->builder, right_block);
+		build_condition(codegen, condition->as.operator_.right, true_block, false_block);
+		return;
+	}
+
+	LLVMValueRef value = handle_rvalue(codegen, parse_node(codegen, condition));
+	LLVMValueRef cond = LLVMBuildIsNotNull(codegen->builder, value, "");
+	LLVMBuildCondBr(codegen->builder, cond, true_block, false_block);
+}
+
+// && and || as values, the right side is evaluated in its own block and
+// joined with the result of the left by a phi
+static LLVMValueRef parse_logical(Codegen *codegen, AstNode *node) {
+	LLVMBasicBlockRef right_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "logical.rhs");
+	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "logical.end");
+	bool is_and = node->as.operator_.type == TOKEN_LOGICAL_AND;
+
+	LLVMValueRef left = handle_rvalue(codegen, parse_node(codegen, node->as.operator_.left));
+	left = LLVMBuildIsNotNull(codegen->builder, left, "");
+	LLVMBasicBlockRef left_block = LLVMGetInsertBlock(codegen->builder);
+	LLVMBuildCondBr(codegen->builder, left, is_and ? right_block : end_block, is_and ? end_block : right_block);
+
+	LLVMPositionBuilderAtEnd(codegen->builder, right_block);
+	LLVMValueRef right = handle_rvalue(codegen, parse_node(codegen, node->as.operator_.right));
+	right = LLVMBuildIsNotNull(codegen->builder, right, "");
+	right_block = LLVMGetInsertBlock(codegen->builder);
+	LLVMBuildBr(codegen->builder, end_block);
+
+	LLVMPositionBuilderAtEnd(codegen->builder, end_block);
+	LLVMValueRef phi = LLVMBuildPhi(codegen->builder, LLVMInt1TypeInContext(codegen->context), "");
+	LLVMValueRef values[2] = { LLVMConstInt(LLVMInt1TypeInContext(codegen->context), !is_and, 0), right };
+	LLVMBasicBlockRef blocks[2] = { left_block, right_block };
+	LLVMAddIncoming(phi, values, blocks, 2);
+	return phi;
+}
+
+static LLVMValueRef parse_operator(Codegen *codegen, AstNode *node) {
+	if (is_logical(node)) {
+		return parse_logical(codegen, node);
+	}
+
+	LLVMValueRef left = handle_rvalue(codegen, parse_node(codegen, node->as.operator_.left));
+	LLVMValueRef right = handle_rvalue(codegen, parse_node(codegen, node->as.operator_.right));
 
 	if (node->as.operator_.type == TOKEN_PLUS ||
 		node->as.operator_.type == TOKEN_MINUS ||
@@ -159,73 +234,89 @@ static LLVMValueRef parse_operator(AstNode *node) {
 		node->as.operator_.type == TOKEN_GREATER_THAN_OR_EQUAL ||
 		node->as.operator_.type == TOKEN_NOT_EQUAL) {
 		TypeInfo *type = deduce_type(node->as.operator_.left, node->as.operator_.right);
-		if (String_cmp(node->as.operator_.left->type_info->value_of, type->value_of) != 0) {
-			left = LLVMBuildCast(builder, LLVMSExt, left, parse_type(type), "");
-		} else if (String_cmp(node->as.operator_.right->type_info->value_of, type->value_of) != 0) {
-			right = LLVMBuildCast(builder, LLVMSExt, right, parse_type(type), "");
+		if (node->as.operator_.left->type_info != type) {
+			left = LLVMBuildCast(codegen->builder, LLVMSExt, left, parse_type(codegen, type), "");
+		} else if (node->as.operator_.right->type_info != type) {
+			right = LLVMBuildCast(codegen->builder, LLVMSExt, right, parse_type(codegen, type), "");
 		}
 	}
 
 	switch (node->as.operator_.type) {
 		// Aritmethic
 		case TOKEN_PLUS:
-			return LLVMBuildAdd(builder, left, right, "");
+			return LLVMBuildAdd(codegen->builder, left, right, "");
 		case TOKEN_MINUS:
-			return LLVMBuildSub(builder, left, right, "");
+			return LLVMBuildSub(codegen->builder, left, right, "");
 		case TOKEN_STAR:
-			return LLVMBuildMul(builder, left, right, "");
+			return LLVMBuildMul(codegen->builder, left, right, "");
 		case TOKEN_SLASH:
-			return LLVMBuildSDiv(builder, left, right, "");
+			return LLVMBuildSDiv(codegen->builder, left, right, "");
 		// Comparison
 		case TOKEN_DOUBLE_EQUAL:
-			return LLVMBuildICmp(builder, LLVMIntEQ, left, right, "");
+			return LLVMBuildICmp(codegen->builder, LLVMIntEQ, left, right, "");
 		case TOKEN_LESS_THAN:
-			return LLVMBuildICmp(builder, LLVMIntSLT, left, right, "");
+			return LLVMBuildICmp(codegen->builder, LLVMIntSLT, left, right, "");
 		case TOKEN_LESS_THAN_OR_EQUAL:
-			return LLVMBuildICmp(builder, LLVMIntSLE, left, right, "");
+			return LLVMBuildICmp(codegen->builder, LLVMIntSLE, left, right, "");
 		case TOKEN_GREATER_THAN:
-			return LLVMBuildICmp(builder, LLVMIntSGT, left, right, "");
+			return LLVMBuildICmp(codegen->builder, LLVMIntSGT, left, right, "");
 		case TOKEN_GREATER_THAN_OR_EQUAL:
-			return LLVMBuildICmp(builder, LLVMIntSGE, left, right, "");
+			return LLVMBuildICmp(codegen->builder, LLVMIntSGE, left, right, "");
 		case TOKEN_NOT_EQUAL:
-			return LLVMBuildICmp(builder, LLVMIntNE, left, right, "");
-		// Logical
-		case TOKEN_LOGICAL_AND:
-			left = LLVMBuildIsNotNull(builder, left, "");
-			right = LLVMBuildIsNotNull(builder, right, "");
-			return LLVMBuildSelect(builder, left, right, left, "");
-		case TOKEN_LOGICAL_OR:
-			left = LLVMBuildIsNotNull(builder, left, "");
-			right = LLVMBuildIsNotNull(builder, right, "");
-			return LLVMBuildSelect(builder, left, left, right, "");
+			return LLVMBuildICmp(codegen->builder, LLVMIntNE, left, right, "");
 		default:
 			report_invalid_node("Unexpected identifier in operator node");
 	}
 	return NULL; // Will never hit, but just to appease the warning gods
 }
 
-static LLVMValueRef parse_variable(AstNode *node) {
-	return node->as.variable.declaration->backend_ref;
+// Globals are declared by earlier repl input, which was generated into a
+// module of its own, so they are looked up by name like functions
+static LLVMValueRef declaration_ref(Codegen *codegen, AstNode *declaration) {
+	if (declaration->type != AST_ASSIGNMENT || declaration->as.assignment.global == NULL) {
+		return declaration->backend_ref;
+	}
+	char *name = declaration->as.assignment.global->name.p;
+	LLVMValueRef global = LLVMGetNamedGlobal(codegen->module, name);
+	if (global == NULL) {
+		global = LLVMAddGlobal(codegen->module, parse_type(codegen, declaration->type_info), name);
+	}
+	return global;
+}
+
+static LLVMValueRef parse_variable(Codegen *codegen, AstNode *node) {
+	return declaration_ref(codegen, node->as.variable.declaration);
 }
 
-static LLVMValueRef parse_assignment(AstNode *node) {
+static LLVMValueRef parse_assignment(Codegen *codegen, AstNode *node) {
 	if (node == node->as.assignment.initial) {
-		char *name = String_to_cstring(node->as.assignment.name);
-		node->backend_ref = LLVMBuildAlloca(builder, parse_type(node->type_info), name);
+		LLVMTypeRef type = parse_type(codegen, node->type_info);
+		if (node->as.assignment.global != NULL) {
+			node->backend_ref = LLVMAddGlobal(codegen->module, type, node->as.assignment.global->name.p);
+			LLVMSetInitializer(node->backend_ref, LLVMConstNull(type));
+		} else {
+			node->backend_ref = build_entry_alloca(codegen, type, node->as.assignment.symbol->name.p);
+		}
 	}
 
+	LLVMValueRef variable = declaration_ref(codegen, node->as.assignment.initial);
 	if (node->as.assignment.value == NULL) {
-		return node->as.assignment.initial->backend_ref;
+		return variable;
 	}
 
-	LLVMValueRef value_node = handle_rvalue(parse_node(node->as.assignment.value));
-	LLVMBuildStore(builder, value_node, node->as.assignment.initial->backend_ref);
+	LLVMValueRef value_node = handle_rvalue(codegen, parse_node(codegen, node->as.assignment.value));
+	LLVMBuildStore(codegen->builder, value_node, variable);
 	return NULL;
 }
 
-static LLVMValueRef parse_function_call(AstNode *node) {
+static LLVMValueRef parse_function_call(Codegen *codegen, AstNode *node) {
 	AstNode *fn_node = node->as.call.function;
-	LLVMValueRef fn = fn_node->backend_ref;
+	// Functions are looked up by name, the same declaration is used by the
+	// modules importing it which are generated concurrently
+	LLVMValueRef fn = LLVMGetNamedFunction(codegen->module, fn_node->as.fn.symbol->name.p);
+	if (fn == NULL) {
+		fn = parse_function_definition(codegen, fn_node->as.fn.symbol->name.p, fn_node);
+	}
 	LLVMTypeRef fn_type = LLVMGlobalGetValueType(fn);
 	List parameters = fn_node->as.fn.parameters;
 
@@ -243,51 +334,64 @@ static LLVMValueRef parse_function_call(AstNode *node) {
 		if (rest && i == n_arguments - 1) {
 			int rest_length = node->as.call.arguments.length - i;
 			TypeInfo *item_type_info = parameter->type_info->pointer_to;
-			bool any_type = String_cmp_cstring(item_type_info->value_of, "any") == 0;
-			LLVMTypeRef item_type = parse_type(item_type_info);
+			bool any_type = item_type_info->tag == TYPE_TAG_ANY;
+			LLVMTypeRef item_type = parse_type(codegen, item_type_info);
 			LLVMTypeRef array_type = LLVMArrayType2(item_type, rest_length);
-			LLVMValueRef alloca = LLVMBuildAlloca(builder, array_type, "");
+			LLVMValueRef alloca = rest_alloca(codegen, array_type, -1);
+
+			// Items are all evaluated before any is stored, calls among them
+			// may use the same rest memory
+			LLVMValueRef items[rest_length > 0 ? rest_length : 1];
+			for (int j = i; j < node->as.call.arguments.length; j++) {
+				AstNode *item_node = LIST_GET(AstNode *, &node->as.call.arguments, j);
+				items[j - i] = handle_rvalue(codegen, parse_node(codegen, item_node));
+			}
 
 			LLVMValueRef indices[2];
-			indices[0] = LLVMConstInt(LLVMInt32TypeInContext(context), 0, 0);
+			indices[0] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), 0, 0);
 
 			for (int j = i; j < node->as.call.arguments.length; j++) {
 				AstNode *item_node = LIST_GET(AstNode *, &node->as.call.arguments, j);
-				LLVMValueRef item = handle_rvalue(parse_node(item_node));
-				indices[1] = LLVMConstInt(LLVMInt32TypeInContext(context), j - 1, 0);
-				LLVMValueRef item_ptr = LLVMBuildGEP2(builder, array_type, alloca, indices, 2, "");
+				LLVMValueRef item = items[j - i];
+				indices[1] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), j - i, 0);
+				LLVMValueRef item_ptr = LLVMBuildGEP2(codegen->builder, array_type, alloca, indices, 2, "");
 				if (any_type) {
-					LLVMValueRef type_ptr = LLVMBuildStructGEP2(builder, item_type, item_ptr, 0, "any.type");
-					LLVMValueRef value_type = LLVMConstInt(LLVMInt32TypeInContext(context),
+					LLVMValueRef type_ptr = LLVMBuildStructGEP2(codegen->builder, item_type, item_ptr, 0, "any.type");
+					LLVMValueRef value_type = LLVMConstInt(LLVMInt32TypeInContext(codegen->context),
 														   get_type_id(item_node->type_info),
 														   0);
-					LLVMBuildStore(builder, value_type, type_ptr);
+					LLVMBuildStore(codegen->builder, value_type, type_ptr);
 
-					LLVMValueRef value_ref = LLVMBuildAlloca(builder, parse_type(item_node->type_info), "any.value_ref");
-					LLVMBuildStore(builder, item, value_ref);
+					LLVMValueRef value_ref = rest_alloca(codegen, parse_type(codegen, item_node->type_info), j - i);
+					LLVMBuildStore(codegen->builder, item, value_ref);
 
-					LLVMValueRef ptr_ptr = LLVMBuildStructGEP2(builder, item_type, item_ptr, 1, "any.value");
-					LLVMBuildStore(builder, value_ref, ptr_ptr);
+					LLVMValueRef ptr_ptr = LLVMBuildStructGEP2(codegen->builder, item_type, item_ptr, 1, "any.value");
+					LLVMBuildStore(codegen->builder, value_ref, ptr_ptr);
 				} else {
-					LLVMBuildStore(builder, item, item_ptr);
+					LLVMBuildStore(codegen->builder, item, item_ptr);
 				}
 			}
 
 			args[i] = alloca;
 		} else {
-			args[i] = handle_rvalue(parse_node(LIST_GET(AstNode *, &node->as.call.arguments, i)));
+			args[i] = handle_rvalue(codegen, parse_node(codegen, LIST_GET(AstNode *, &node->as.call.arguments, i)));
 		}
 	}
 
-	return LLVMBuildCall2(builder, fn_type, fn, args, n_arguments, "");
+	return LLVMBuildCall2(codegen->builder, fn_type, fn, args, n_arguments, "");
 }
 
-static LLVMValueRef parse_function_definition(char *name, AstNode *node) {
+static LLVMValueRef parse_function_definition(Codegen *codegen, char *name, AstNode *node) {
+	LLVMValueRef fn = LLVMGetNamedFunction(codegen->module, name);
+	if (fn != NULL) {
+		return fn;
+	}
+
 	LLVMTypeRef return_type = NULL;
 	if (node->as.fn.type == NULL) {
-		return_type = LLVMVoidTypeInContext(context);
+		return_type = LLVMVoidTypeInContext(codegen->context);
 	} else {
-		return_type = parse_type(node->type_info);
+		return_type = parse_type(codegen, node->type_info);
 	}
 
 	LLVMTypeRef *parameters = NULL;
@@ -297,7 +401,7 @@ static LLVMValueRef parse_function_definition(char *name, AstNode *node) {
 
 
 			AstNode *parameter_node = LIST_GET(AstNode *, &node->as.fn.parameters, i);
-			parameters[i] = parse_type(&parameter_node->as.parameter.type_info);
+			parameters[i] = parse_type(codegen, parameter_node->as.parameter.type_info);
 			if (parameter_node->as.parameter.rest) {
 				parameters[i] = LLVMPointerType(parameters[i], 0);
 			}
@@ -310,359 +414,489 @@ static LLVMValueRef parse_function_definition(char *name, AstNode *node) {
 		node->as.fn.parameters.length,
 		node->as.fn.vararg
 	);
-    LLVMValueRef fn = LLVMAddFunction(module, name, fn_type);
-	node->backend_ref = fn;
-	return fn;
+    return LLVMAddFunction(codegen->module, name, fn_type);
 }
 
-static LLVMValueRef parse_function(AstNode *node) {
-	char *name = resolve_identifier(node->as.fn.name, node->as.fn.external);
-
-	Table locals;
-    table_init(&locals);
+static LLVMValueRef parse_function(Codegen *codegen, AstNode *node) {
+	char *name = node->as.fn.symbol->name.p;
+	Timer timer = timer_start(codegen->timings);
 
-	LLVMValueRef fn = parse_function_definition(name, node);
-	current_function = fn;
+	LLVMValueRef fn = parse_function_definition(codegen, name, node);
+	codegen->current_function = fn;
 	if (node->as.fn.statements.elements != NULL) {
-		LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(context, fn, "");
-		LLVMPositionBuilderAtEnd(builder, block);
-
+		// The entry block only has allocas, it branches to the body once the
+		// function is generated
+		LLVMBasicBlockRef entry_block = LLVMAppendBasicBlockInContext(codegen->context, fn, "entry");
+		LLVMBasicBlockRef block = LLVMAppendBasicBlockInContext(codegen->context, fn, "");
+		LLVMPositionBuilderAtEnd(codegen->entry, entry_block);
+		LLVMPositionBuilderAtEnd(codegen->builder, block);
+		codegen->rest_allocas.length = 0;
+
+		// Parameters are spilled, so they can be assigned like locals
 		for (int i = 0; i < node->as.fn.parameters.length; i++) {
 			AstNode *parameter_node = LIST_GET(AstNode *, &node->as.fn.parameters, i);
 			LLVMValueRef param_value = LLVMGetParam(fn, i);
-			char *param_name = String_to_cstring(parameter_node->as.parameter.name);
-			LLVMSetValueName2(param_value, param_name, parameter_node->as.parameter.name.length);
-			parameter_node->backend_ref = param_value;
+			Symbol *param_name = parameter_node->as.parameter.symbol;
+			LLVMSetValueName2(param_value, param_name->name.p, param_name->name.length);
+			LLVMValueRef alloca = build_entry_alloca(codegen, LLVMTypeOf(param_value), param_name->name.p);
+			LLVMBuildStore(codegen->entry, param_value, alloca);
+			parameter_node->backend_ref = alloca;
 		}
-		
 
 		for (int i = 0; i < node->as.fn.statements.length; i++) {
-			parse_node(LIST_GET(AstNode *, &node->as.fn.statements, i));
+			parse_node(codegen, LIST_GET(AstNode *, &node->as.fn.statements, i));
 		}
 	}
 
 	if (node->as.fn.type == NULL &&
 		(node->as.fn.statements.elements == NULL ||
 		LIST_GET(AstNode *, &node->as.fn.statements, node->as.fn.statements.length - 1)->type != AST_RETURN)) {
-		LLVMBuildRetVoid(builder);
+		LLVMBuildRetVoid(codegen->builder);
+	}
+	if (node->as.fn.statements.elements != NULL) {
+		LLVMBuildBr(codegen->entry, LLVMGetNextBasicBlock(LLVMGetEntryBasicBlock(fn)));
 	}
 
-	current_function = NULL;
+	codegen->current_function = NULL;
+	timer_stop(codegen->timings, timer, "codegen", codegen->name, name);
 	return fn;
 }
 
-static LLVMValueRef parse_while(AstNode *node) {
-	LLVMBasicBlockRef start_block = LLVMAppendBasicBlockInContext(context, current_function, "while.start");
-	LLVMBasicBlockRef body_block = LLVMAppendBasicBlockInContext(context, current_function, "while.body");
-	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(context, current_function, "while.end");
+static LLVMValueRef parse_while(Codegen *codegen, AstNode *node) {
+	LLVMBasicBlockRef start_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "while.start");
+	LLVMBasicBlockRef body_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "while.body");
+	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "while.end");
 
-	LLVMBuildBr(builder, start_block);
-	LLVMPositionBuilderAtEnd(builder, start_block);
-	LLVMValueRef expr = handle_rvalue(parse_node(node->as.while_.condition));
-	LLVMValueRef null = LLVMConstNull(parse_type(node->as.while_.condition->type_info));
-	LLVMValueRef cond = LLVMBuildICmp(builder, LLVMIntNE, expr, null, "");
-	LLVMBuildCondBr(builder, cond, body_block, end_block);
+	LLVMBuildBr(codegen->builder, start_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, start_block);
+	build_condition(codegen, node->as.while_.condition, body_block, end_block);
 
-	LLVMPositionBuilderAtEnd(builder, body_block);
-	parse_node(node->as.while_.statement);
-	LLVMBuildBr(builder, start_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, body_block);
+	parse_node(codegen, node->as.while_.statement);
+	LLVMBuildBr(codegen->builder, start_block);
 	
-	LLVMPositionBuilderAtEnd(builder, end_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, end_block);
 	return NULL;
 }
 
-static LLVMValueRef parse_if(AstNode *node) {
-	LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(context, current_function, "if.then");
+static LLVMValueRef parse_if(Codegen *codegen, AstNode *node) {
+	LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "if.then");
 	LLVMBasicBlockRef else_block;
 	if (node->as.if_.else_statement != NULL) {
-		else_block = LLVMAppendBasicBlockInContext(context, current_function, "if.else");
+		else_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "if.else");
 	} else {
 		else_block = NULL;
 	}
-	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(context, current_function, "if.end");
+	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "if.end");
 	
-	LLVMValueRef expr = handle_rvalue(parse_node(node->as.if_.condition));
-	LLVMValueRef null = LLVMConstNull(parse_type(node->as.if_.condition->type_info));
-	LLVMValueRef cond = LLVMBuildICmp(builder, LLVMIntNE, expr, null, "");
-	LLVMBuildCondBr(builder, cond, then_block, else_block == NULL ? end_block : else_block);
+	build_condition(codegen, node->as.if_.condition, then_block, else_block == NULL ? end_block : else_block);
 
-	LLVMPositionBuilderAtEnd(builder, then_block);
-	LLVMValueRef statement_value = parse_node(node->as.if_.statement);
+	LLVMPositionBuilderAtEnd(codegen->builder, then_block);
+	LLVMValueRef statement_value = parse_node(codegen, node->as.if_.statement);
 	if (statement_value == NULL || LLVMGetInstructionOpcode(statement_value) > LLVMUnreachable) {
-		LLVMBuildBr(builder, end_block);
+		LLVMBuildBr(codegen->builder, end_block);
 	}
 
 	if (else_block != NULL) {
-		LLVMPositionBuilderAtEnd(builder, else_block);
-		LLVMValueRef then_value = parse_node(node->as.if_.else_statement);
+		LLVMPositionBuilderAtEnd(codegen->builder, else_block);
+		LLVMValueRef then_value = parse_node(codegen, node->as.if_.else_statement);
 		if (then_value == NULL || LLVMGetInstructionOpcode(then_value) > LLVMUnreachable) {
-			LLVMBuildBr(builder, end_block);
+			LLVMBuildBr(codegen->builder, end_block);
 		}
 	}
 	
-	LLVMPositionBuilderAtEnd(builder, end_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, end_block);
 	return NULL;
 }
 
-static LLVMValueRef parse_return(AstNode *node) {
-	LLVMValueRef expr = handle_rvalue(parse_node(node->as.return_.expression));
-	return LLVMBuildRet(builder, expr);
+static LLVMValueRef parse_return(Codegen *codegen, AstNode *node) {
+	LLVMValueRef expr = handle_rvalue(codegen, parse_node(codegen, node->as.return_.expression));
+	return LLVMBuildRet(codegen->builder, expr);
 }
 
-static LLVMValueRef parse_block(AstNode *node) {
+static LLVMValueRef parse_block(Codegen *codegen, AstNode *node) {
 	Table locals;
     table_init(&locals);
 	LLVMValueRef value;
 	for (int i = 0; i < node->as.block.statements.length; i++) {
 		AstNode *stmnt = LIST_GET(AstNode *, &node->as.block.statements, i);
-		value = parse_node(stmnt);
+		value = parse_node(codegen, stmnt);
 	}
 	return value;
 }
 
-static LLVMValueRef parse_bool(AstNode *node) {
-    LLVMTypeRef bool_type = LLVMInt1TypeInContext(context);
+static LLVMValueRef parse_bool(Codegen *codegen, AstNode *node) {
+    LLVMTypeRef bool_type = LLVMInt1TypeInContext(codegen->context);
     return LLVMConstInt(bool_type, node->as.bool_, 1);
 }
 
-static LLVMValueRef parse_import(AstNode *node) {
-	AstNode *file_node = node->as.import.file_node;
-	List *import_file_nodes = &file_node->as.file.nodes;
-	for (int i = 0; i < import_file_nodes->length; i++) {
-		AstNode *i_node = LIST_GET(AstNode *, import_file_nodes, i);
-		if (i_node->type == AST_FUNCTION && !i_node->as.fn.external) {
-			char *i_name = resolve_identifier_name(file_node->as.file.path, i_node->as.fn.name);
-			parse_function_definition(i_name, i_node);
-		}
-	}
+// Imported functions are declared when they are first called, so a module
+// only declares what it uses and std links only that
+static LLVMValueRef parse_import(Codegen *codegen, AstNode *node) {
 	return NULL;
 }
 
-static LLVMValueRef parse_accessor(AstNode *node) {
-	File *file = &node->as.accessor.left->as.variable.declaration->as.file;
-
-	char *current_module_path = module_path;
-
-	module_path = file->path;
-	LLVMValueRef result = parse_node(node->as.accessor.right);
-
-	module_path = current_module_path;
-	return result;
+static LLVMValueRef parse_accessor(Codegen *codegen, AstNode *node) {
+	return parse_node(codegen, node->as.accessor.right);
 }
 
-static LLVMValueRef parse_array(AstNode *node) {
+static LLVMValueRef parse_array(Codegen *codegen, AstNode *node) {
 	List items = node->as.array.items;
 	LLVMValueRef values[items.length];
-	LLVMTypeRef item_type = parse_type(node->type_info->array.of);
+	LLVMTypeRef item_type = parse_type(codegen, node->type_info->array.of);
 	for (int i = 0; i < items.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &items, i);
-		values[i] = parse_node(i_node);
+		values[i] = parse_node(codegen, i_node);
 	}
 	
 	LLVMValueRef value = LLVMConstArray2(item_type, values, items.length);
 	return value;
 }
 
-static LLVMValueRef parse_item_access(AstNode *node) {
-	LLVMValueRef indexable = parse_node(node->as.item_access.indexable);
-	LLVMValueRef index = handle_rvalue(parse_node(node->as.item_access.index));
+static LLVMValueRef parse_item_access(Codegen *codegen, AstNode *node) {
+	LLVMValueRef indexable = handle_rvalue(codegen, parse_node(codegen, node->as.item_access.indexable));
+	LLVMValueRef index = handle_rvalue(codegen, parse_node(codegen, node->as.item_access.index));
 
 	LLVMValueRef item_pointer;
 	LLVMTypeRef item_type;
 	TypeInfo *type_info = node->as.item_access.indexable->type_info;
-	LLVMTypeRef allocated_type = parse_type(type_info);
+	LLVMTypeRef allocated_type = parse_type(codegen, type_info);
 	if (type_info->type == TYPE_ARRAY) {
 		item_type = LLVMGetElementType(allocated_type);
 
 		LLVMValueRef indices[2];
-		indices[0] = LLVMConstInt(LLVMInt32TypeInContext(context), 0, 0);
+		indices[0] = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), 0, 0);
 		indices[1] = index;
-		item_pointer = LLVMBuildGEP2(builder, allocated_type, indexable, indices, 2, "");
+		item_pointer = LLVMBuildGEP2(codegen->builder, allocated_type, indexable, indices, 2, "");
 	} else {
-		item_type = parse_type(type_info->pointer_to);
+		item_type = parse_type(codegen, type_info->pointer_to);
 
 		LLVMValueRef indices[1] = { index };
-		item_pointer = LLVMBuildGEP2(builder, item_type, indexable, indices, 1, "");
+		item_pointer = LLVMBuildGEP2(codegen->builder, item_type, indexable, indices, 1, "");
 	}
-	return LLVMBuildLoad2(builder, item_type, item_pointer, "");
+	return LLVMBuildLoad2(codegen->builder, item_type, item_pointer, "");
 }
 
-static LLVMValueRef parse_match(AstNode *node) {
-	LLVMBasicBlockRef start_block = LLVMAppendBasicBlockInContext(context, current_function, "match.start");
-	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(context, current_function, "match.end");
+static LLVMValueRef parse_match(Codegen *codegen, AstNode *node) {
+	LLVMBasicBlockRef start_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "match.start");
+	LLVMBasicBlockRef end_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "match.end");
 
-	LLVMBuildBr(builder, start_block);
-	LLVMPositionBuilderAtEnd(builder, start_block);
+	LLVMBuildBr(codegen->builder, start_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, start_block);
 
-	LLVMValueRef any_value = parse_node(node->as.match.matcher);
+	LLVMValueRef any_value = handle_rvalue(codegen, parse_node(codegen, node->as.match.matcher));
 
-	LLVMValueRef type_value = LLVMBuildExtractValue(builder, any_value, 0, "match.type.value");
-	LLVMValueRef value_ptr = LLVMBuildExtractValue(builder, any_value, 1, "match.value.ptr");
+	LLVMValueRef type_value = LLVMBuildExtractValue(codegen->builder, any_value, 0, "match.type.value");
+	LLVMValueRef value_ptr = LLVMBuildExtractValue(codegen->builder, any_value, 1, "match.value.ptr");
 
 	LLVMBasicBlockRef next_block = end_block;
 	for (int i = node->as.match.branches.length - 1; i >= 0; i--) {
-		LLVMPositionBuilderAtEnd(builder, next_block);
+		LLVMPositionBuilderAtEnd(codegen->builder, next_block);
 
-		LLVMBasicBlockRef option_block = LLVMAppendBasicBlockInContext(context, current_function, "match.option");
-		LLVMBasicBlockRef result_block = LLVMAppendBasicBlockInContext(context, current_function, "match.result");
+		LLVMBasicBlockRef option_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "match.option");
+		LLVMBasicBlockRef result_block = LLVMAppendBasicBlockInContext(codegen->context, codegen->current_function, "match.result");
 
-		LLVMPositionBuilderAtEnd(builder, option_block);
+		LLVMPositionBuilderAtEnd(codegen->builder, option_block);
 		MatchBranch branch = LIST_GET(MatchBranch, &node->as.match.branches, i);
-		LLVMValueRef branch_type_id = LLVMConstInt(LLVMInt32TypeInContext(context), get_type_id(branch.type_info), 0);
-		LLVMValueRef condition = LLVMBuildICmp(builder, LLVMIntEQ, type_value, branch_type_id, "");
-		LLVMBuildCondBr(builder, condition, result_block, next_block);
-
-		LLVMPositionBuilderAtEnd(builder, result_block);
-		char *name = String_to_cstring(branch.identifier->as.variable.name);
-		LLVMTypeRef branch_type = parse_type(branch.type_info);
-		branch.identifier->backend_ref = LLVMBuildAlloca(builder, branch_type, name);
-		LLVMValueRef value_value = LLVMBuildLoad2(builder, branch_type, value_ptr, "match.value.value");
-		LLVMBuildStore(builder, value_value, branch.identifier->backend_ref);
-		parse_node(branch.expression);
-		LLVMBuildBr(builder, end_block);
+		LLVMValueRef branch_type_id = LLVMConstInt(LLVMInt32TypeInContext(codegen->context), get_type_id(branch.type_info), 0);
+		LLVMValueRef condition = LLVMBuildICmp(codegen->builder, LLVMIntEQ, type_value, branch_type_id, "");
+		LLVMBuildCondBr(codegen->builder, condition, result_block, next_block);
+
+		LLVMPositionBuilderAtEnd(codegen->builder, result_block);
+		char *name = branch.identifier->as.variable.symbol->name.p;
+		LLVMTypeRef branch_type = parse_type(codegen, branch.type_info);
+		branch.identifier->backend_ref = build_entry_alloca(codegen, branch_type, name);
+		LLVMValueRef value_value = LLVMBuildLoad2(codegen->builder, branch_type, value_ptr, "match.value.value");
+		LLVMBuildStore(codegen->builder, value_value, branch.identifier->backend_ref);
+		parse_node(codegen, branch.expression);
+		LLVMBuildBr(codegen->builder, end_block);
 
 		next_block = option_block;
 	}
 
-	LLVMPositionBuilderAtEnd(builder, start_block);
-	LLVMBuildBr(builder, next_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, start_block);
+	LLVMBuildBr(codegen->builder, next_block);
 
-	LLVMPositionBuilderAtEnd(builder, end_block);
+	LLVMPositionBuilderAtEnd(codegen->builder, end_block);
 	return NULL;
 }
 
-static LLVMValueRef parse_file_node(AstNode *node) {
+static LLVMValueRef parse_file_node(Codegen *codegen, AstNode *node) {
 	List *nodes = &node->as.file.nodes;
     for (int i = 0; i < nodes->length; i++) {
-        parse_node(LIST_GET(AstNode *, nodes, i));
+        parse_node(codegen, LIST_GET(AstNode *, nodes, i));
     }
 
 	return NULL;
 }
 
-static LLVMValueRef parse_node(AstNode *node) {
+static LLVMValueRef parse_node(Codegen *codegen, AstNode *node) {
 	switch (node->type) {
 		case AST_OPERATOR:
-			return parse_operator(node);
+			return parse_operator(codegen, node);
 		case AST_NUMBER:
-			return parse_number(node);
+			return parse_number(codegen, node);
 		case AST_ASSIGNMENT:
-			return parse_assignment(node);
+			return parse_assignment(codegen, node);
 		case AST_VARIABLE:
-			return parse_variable(node);
+			return parse_variable(codegen, node);
 		case AST_STRING:
-			return parse_string(node);
+			return parse_string(codegen, node);
 		case AST_FILE:
-			return parse_file_node(node);
+			return parse_file_node(codegen, node);
 		case AST_FUNCTION_CALL:
-			return parse_function_call(node);
+			return parse_function_call(codegen, node);
 		case AST_FUNCTION:
-			return parse_function(node);
+			return parse_function(codegen, node);
 		case AST_WHILE:
-			return parse_while(node);
+			return parse_while(codegen, node);
 		case AST_IF:
-			return parse_if(node);
+			return parse_if(codegen, node);
 		case AST_RETURN:
-			return parse_return(node);
+			return parse_return(codegen, node);
 		case AST_BLOCK:
-			return parse_block(node);
+			return parse_block(codegen, node);
 		case AST_BOOL:
-			return parse_bool(node);
+			return parse_bool(codegen, node);
 		case AST_IMPORT:
-			return parse_import(node);
+			return parse_import(codegen, node);
 		case AST_ACCESSOR:
-			return parse_accessor(node);
+			return parse_accessor(codegen, node);
 		case AST_ARRAY:
-			return parse_array(node);
+			return parse_array(codegen, node);
 		case AST_ITEM_ACCESS:
-			return parse_item_access(node);
+			return parse_item_access(codegen, node);
 		case AST_MATCH:
-			return parse_match(node);
+			return parse_match(codegen, node);
 		default:
 			report_invalid_node("Unhandled node types");
     }
 	return NULL; // Will never hit, but just to appease the warning gods
 }
 
-void compiler_initialize(Table *modules_) {
-    context = LLVMContextCreate();
-
-    table_init(&types);
-	table_put(&types, STRING("bool"), LLVMInt1TypeInContext(context));
-	table_put(&types, STRING("s1"), LLVMInt8TypeInContext(context));
-	table_put(&types, STRING("s2"), LLVMInt16TypeInContext(context));
-	table_put(&types, STRING("s4"), LLVMInt32TypeInContext(context));
-	table_put(&types, STRING("s8"), LLVMInt64TypeInContext(context));
+static void initialize_types(Codegen *codegen, Types *types) {
+	LLVMContextRef context = codegen->context;
+	LLVMTypeRef s1 = LLVMInt8TypeInContext(context);
+	LLVMTypeRef s4 = LLVMInt32TypeInContext(context);
+	codegen->types[type_value(types, STRING("bool"))->id] = LLVMInt1TypeInContext(context);
+	codegen->types[type_value(types, STRING("s1"))->id] = s1;
+	codegen->types[type_value(types, STRING("s2"))->id] = LLVMInt16TypeInContext(context);
+	codegen->types[type_value(types, STRING("s4"))->id] = s4;
+	codegen->types[type_value(types, STRING("s8"))->id] = LLVMInt64TypeInContext(context);
 
 	LLVMTypeRef	string_type = LLVMStructCreateNamed(context, "string");
 	LLVMTypeRef string_elements[2];
-	string_elements[0] = table_get(&types, STRING("s4"));
-	string_elements[1] = LLVMPointerType(table_get(&types, STRING("s1")), 0);
+	string_elements[0] = s4;
+	string_elements[1] = LLVMPointerType(s1, 0);
 	LLVMStructSetBody(string_type, string_elements, 2, false);
-	table_put(&types, STRING("string"), string_type);
+	codegen->types[type_value(types, STRING("string"))->id] = string_type;
 
 	LLVMTypeRef	any_type = LLVMStructCreateNamed(context, "any");
 	LLVMTypeRef any_elements[2];
-	any_elements[0] = table_get(&types, STRING("s4"));
+	any_elements[0] = s4;
 	any_elements[1] = LLVMPointerTypeInContext(context, 0);
 	LLVMStructSetBody(any_type, any_elements, 2, false);
-	table_put(&types, STRING("any"), any_type);
+	codegen->types[type_value(types, STRING("any"))->id] = any_type;
 }
 
-LLVMModuleRef build_module(AstNode *file_node, char *dir, char *name, bool entry) {
-    builder = LLVMCreateBuilderInContext(context);
-    module = LLVMModuleCreateWithNameInContext(name, context);
-	module_path = file_node->as.file.path;
-
-	parse_node(file_node);
-
-	module_path = NULL;
-	LLVMDisposeBuilder(builder);
-	return module;
+// Builds file_node into a module in context. A context is only used by one
+// thread at a time, dispose_module disposes the module with its context.
+LLVMModuleRef build_module(Compilation *compilation, LLVMContextRef context, AstNode *file_node, char *dir, char *name, bool entry) {
+	Timer timer = timer_start(&compilation->timings);
+	size_t heap = memory_heap();
+	Codegen codegen;
+	codegen.context = context;
+	codegen.types = calloc(compilation->types.next_id, sizeof(LLVMTypeRef));
+    codegen.builder = LLVMCreateBuilderInContext(codegen.context);
+	codegen.entry = LLVMCreateBuilderInContext(codegen.context);
+	list_init(&codegen.rest_allocas, sizeof(RestAlloca));
+    codegen.module = LLVMModuleCreateWithNameInContext(name, codegen.context);
+	codegen.current_function = NULL;
+	codegen.timings = &compilation->timings;
+	codegen.name = name;
+	initialize_types(&codegen, &compilation->types);
+
+	parse_node(&codegen, file_node);
+
+	LLVMDisposeBuilder(codegen.builder);
+	LLVMDisposeBuilder(codegen.entry);
+	free(codegen.rest_allocas.elements);
+	free(codegen.types);
+	memory_count_heap(heap);
+	timer_stop(&compilation->timings, timer, "codegen", name, NULL);
+	return codegen.module;
 }
 
-void compile(LLVMModuleRef module, char *name) {
-#ifdef DEBUG
-	char *code = LLVMPrintModuleToString(module);
-	printf("code:\n\n%s\n", code);
-#endif
+void dispose_module(LLVMModuleRef module) {
+	LLVMContextRef context = LLVMGetModuleContext(module);
+	LLVMDisposeModule(module);
+	LLVMContextDispose(context);
+}
 
+static void initialize_targets() {
 	LLVMInitializeAllTargetInfos();
 	LLVMInitializeAllTargets();
 	LLVMInitializeAllTargetMCs();
 	LLVMInitializeAllAsmParsers();
 	LLVMInitializeAllAsmPrinters();
+}
+
+static LLVMCodeGenOptLevel codegen_opt_level(char opt_level) {
+	switch (opt_level) {
+		case '0': return LLVMCodeGenLevelNone;
+		case '1': return LLVMCodeGenLevelLess;
+		case '3': return LLVMCodeGenLevelAggressive;
+		default:  return LLVMCodeGenLevelDefault;
+	}
+}
+
+// Runs the custom pipeline in the options, or the default one of the
+// optimization level
+static void run_passes(LLVMModuleRef module, LLVMTargetMachineRef target_machine, PenquinOptions *options) {
+	char pipeline[16];
+	char *passes = options->passes;
+	if (passes == NULL) {
+		if (options->opt_level == '0') {
+			return;
+		}
+		sprintf(pipeline, "default<O%c>", options->opt_level);
+		passes = pipeline;
+	}
 
-	char object_file_path[256];
-	sprintf(object_file_path, "/tmp/%s.o", name);
+	LLVMPassBuilderOptionsRef pass_options = LLVMCreatePassBuilderOptions();
+	LLVMErrorRef error = LLVMRunPasses(module, passes, target_machine, pass_options);
+	LLVMDisposePassBuilderOptions(pass_options);
+	if (error != NULL) {
+		char *message = LLVMGetErrorMessage(error);
+		fprintf(stderr, "Epic fail: passes %s: %s\n", passes, message);
+		LLVMDisposeErrorMessage(message);
+		exit(1);
+	}
+}
+
+// The optimizer reads the target of each function from its attributes,
+// so the vectorizers know which instructions they may use
+static void set_target_attributes(LLVMModuleRef module, Compilation *compilation) {
+	LLVMContextRef context = LLVMGetModuleContext(module);
+	for (LLVMValueRef function = LLVMGetFirstFunction(module); function != NULL; function = LLVMGetNextFunction(function)) {
+		if (LLVMIsDeclaration(function)) {
+			continue;
+		}
+		if (compilation->cpu[0] != '\0') {
+			LLVMAttributeRef cpu = LLVMCreateStringAttribute(context, "target-cpu", 10, compilation->cpu, strlen(compilation->cpu));
+			LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, cpu);
+		}
+		if (compilation->features[0] != '\0') {
+			LLVMAttributeRef features = LLVMCreateStringAttribute(context, "target-features", 15, compilation->features, strlen(compilation->features));
+			LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, features);
+		}
+	}
+}
+
+void optimize_module(LLVMModuleRef module, LLVMTargetMachineRef target_machine, Compilation *compilation) {
+	set_target_attributes(module, compilation);
+	run_passes(module, target_machine, &compilation->options);
+}
+
+// Target machine for the host with the CPU, features and optimization
+// level of the compilation. Every thread uses its own, so modules can be
+// emitted concurrently.
+LLVMTargetMachineRef create_target_machine(Compilation *compilation) {
+	// Targets are registered once per process
+	static pthread_once_t targets_initialized = PTHREAD_ONCE_INIT;
+	pthread_once(&targets_initialized, initialize_targets);
 
 	char *err;
-	LLVMBool failed;
 	LLVMTargetRef target_ref;
-
-	const char *target_triple = LLVMGetDefaultTargetTriple();
-	failed = LLVMGetTargetFromTriple(target_triple, &target_ref, &err);
-	if (failed) {
+	char *target_triple = LLVMGetDefaultTargetTriple();
+	if (LLVMGetTargetFromTriple(target_triple, &target_ref, &err)) {
 		printf("LLVM: %s\n", err);
 		exit(1);
 	}
 
 	LLVMTargetMachineOptionsRef target_machine_options_ref = LLVMCreateTargetMachineOptions();
 	LLVMTargetMachineOptionsSetRelocMode(target_machine_options_ref, LLVMRelocPIC);
+	LLVMTargetMachineOptionsSetCodeGenOptLevel(target_machine_options_ref, codegen_opt_level(compilation->options.opt_level));
+	LLVMTargetMachineOptionsSetCPU(target_machine_options_ref, compilation->cpu);
+	LLVMTargetMachineOptionsSetFeatures(target_machine_options_ref, compilation->features);
 	LLVMTargetMachineRef target_machine_ref = LLVMCreateTargetMachineWithOptions(target_ref, target_triple, target_machine_options_ref);
+	LLVMDisposeTargetMachineOptions(target_machine_options_ref);
+	LLVMDisposeMessage(target_triple);
+	return target_machine_ref;
+}
+
+// Verifies module when enabled, an invalid module is a bug in codegen
+void verify_module(LLVMModuleRef module, Compilation *compilation) {
+	if (!compilation->options.verify) {
+		return;
+	}
+	size_t length;
+	const char *name = LLVMGetModuleIdentifier(module, &length);
+	Timer timer = timer_start(&compilation->timings);
+	if (LLVMVerifyModule(module, LLVMPrintMessageAction, NULL)) {
+		fprintf(stderr, "Epic fail: invalid module %s\n", name);
+		fail();
+	}
+	timer_stop(&compilation->timings, timer, "verify", name, NULL);
+}
+
+// Optimizes and emits module into the object file at path
+void emit_object(LLVMModuleRef module, Compilation *compilation, char *path) {
+	size_t length;
+	const char *name = LLVMGetModuleIdentifier(module, &length);
+	size_t heap = memory_heap();
+	LLVMTargetMachineRef target_machine_ref = create_target_machine(compilation);
+	Timer timer = timer_start(&compilation->timings);
+	optimize_module(module, target_machine_ref, compilation);
+	timer_stop(&compilation->timings, timer, "optimize", name, NULL);
 
-	failed = LLVMTargetMachineEmitToFile(target_machine_ref, module, object_file_path, LLVMObjectFile, &err);
-	if (failed) {
+	char *err;
+	if (compilation->options.emit_llvm) {
+		char *ll = dump_path((char *)name, ".ll");
+		if (LLVMPrintModuleToFile(module, ll, &err)) {
+			fprintf(stderr, "Epic fail: unable to write %s: %s\n", ll, err);
+			exit(1);
+		}
+		free(ll);
+	}
+	timer = timer_start(&compilation->timings);
+	if (LLVMTargetMachineEmitToFile(target_machine_ref, module, path, LLVMObjectFile, &err)) {
 		printf("LLVM: %s\n", err);
 		exit(1);
 	}
+	timer_stop(&compilation->timings, timer, "emit", name, NULL);
+	if (compilation->options.emit_asm) {
+		char *s = dump_path((char *)name, ".s");
+		if (LLVMTargetMachineEmitToFile(target_machine_ref, module, s, LLVMAssemblyFile, &err)) {
+			printf("LLVM: %s\n", err);
+			exit(1);
+		}
+		free(s);
+	}
+	LLVMDisposeTargetMachine(target_machine_ref);
+	memory_count_heap(heap);
+}
+
+// Links the object files into the executable name, removing them after if
+// they are temporary
+void link_objects(char **paths, int count, char *name, bool temporary) {
+	size_t length = strlen("clang -o ") + strlen(name) + 1;
+	for (int i = 0; i < count; i++) {
+		length += strlen(paths[i]) + 1;
+	}
+	char *cmd = malloc(length);
+	int n = sprintf(cmd, "clang -o %s", name);
+	for (int i = 0; i < count; i++) {
+		n += sprintf(cmd + n, " %s", paths[i]);
+	}
 
-	char cmd[512];
-	sprintf(cmd, "clang %s -o %s", object_file_path, name);
 	int link_result = system(cmd);
+	for (int i = 0; temporary && i < count; i++) {
+		remove(paths[i]);
+	}
 	if (link_result) {
 		printf("Unable to link using clang, command: %s\n", cmd);
 		exit(1);
 	}
+	free(cmd);
 }
-
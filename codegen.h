@@ -2,12 +2,17 @@
 #define PENQUIN_CODEGEN_H
 
 #include <stdbool.h>
+#include <llvm-c/TargetMachine.h>
 #include <llvm-c/Types.h>
 #include "table.h"
 #include "parser.h"
 
-LLVMModuleRef build_module(AstNode *file_node, char *dir, char *name, bool entry);
-void compile(LLVMModuleRef module, char *name);
-void compiler_initialize(Table *modules);
+LLVMModuleRef build_module(Compilation *compilation, LLVMContextRef context, AstNode *file_node, char *dir, char *name, bool entry);
+LLVMTargetMachineRef create_target_machine(Compilation *compilation);
+void          dispose_module(LLVMModuleRef module);
+void          emit_object(LLVMModuleRef module, Compilation *compilation, char *path);
+void          link_objects(char **paths, int count, char *name, bool temporary);
+void          optimize_module(LLVMModuleRef module, LLVMTargetMachineRef target_machine, Compilation *compilation);
+void          verify_module(LLVMModuleRef module, Compilation *compilation);
 
 #endif
@@ -1,13 +1,11 @@
 #ifndef PENQUIN_COMMON_H
 #define PENQUIN_COMMON_H
 
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 
-#define DEBUG
-
-
 #define DEFINE_CSTRING(name, string) char name[string.length + 1];\
 									 memcpy(name, string.p, string.length);\
 								  	 name[string.length] = '\0';
@@ -27,9 +25,17 @@ void    String_free(String s);
 bool    String_starts_with(String s, char *c);
 char   *String_to_cstring(String s);
 
+// Compile errors are reported where they are found and end the process,
+// unless the thread set a point to recover at, like the repl does for each
+// input
+_Noreturn void fail();
+void fail_recover(jmp_buf *recovery);
+
+char *dump_path(char *path, char *extension);
 char *get_directory(char *path);
+FILE *open_dump(char *path, char *extension);
 char *path_to_name(char *path);
-void read_file(FILE *file, char **data);
-void read_file_from_path(char *path, char **data);
+size_t read_file_from_path(char *path, char **data);
+void release_file(char *data, size_t size);
 
 #endif
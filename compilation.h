@@ -0,0 +1,32 @@
+#ifndef PENQUIN_COMPILATION_H
+#define PENQUIN_COMPILATION_H
+
+#include "arena.h"
+#include "cache.h"
+#include "memory.h"
+#include "module.h"
+#include "parser.h"
+#include "penquin.h"
+#include "pool.h"
+#include "symbol.h"
+#include "timing.h"
+#include "type.h"
+
+struct Compilation {
+	PenquinOptions options;
+	Arena arena;   // scopes
+	Arena *arenas; // AST nodes, one per pool worker
+	Symbols symbols;
+	Types types;
+	Pool pool;
+	ModuleGraph graph;
+	Cache cache;
+	Scope global_scope;
+	List scopes;    // Scope *, their tables are freed with the compilation
+	char *cpu;      // for the target machine, options with native resolved
+	char *features;
+	Timings timings;
+	Memory memory;
+};
+
+#endif
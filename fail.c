@@ -0,0 +1,17 @@
+#include <setjmp.h>
+#include <stdlib.h>
+#include "common.h"
+
+// Only the thread evaluating repl input recovers, workers always exit
+static _Thread_local jmp_buf *recovery = NULL;
+
+void fail_recover(jmp_buf *point) {
+	recovery = point;
+}
+
+void fail() {
+	if (recovery != NULL) {
+		longjmp(*recovery, 1);
+	}
+	exit(1);
+}
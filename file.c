@@ -1,6 +1,12 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 
 char *get_directory(char *path) {
@@ -9,41 +15,112 @@ char *get_directory(char *path) {
 	return dname;
 }
 
+// Name of the module at path, std modules have paths like std:core
 char *path_to_name(char *path) {
 	int path_length = strlen(path);
 	int begin_name_index = -1;
 	for (int i = 0; i < path_length; i++) {
-		if (path[i] == '/') {
+		if (path[i] == '/' || path[i] == ':') {
 			begin_name_index = i;
 		}
 	}
 	begin_name_index++;
-	
-	int name_length = path_length - begin_name_index - 3;
+
+	int name_length = path_length - begin_name_index;
+	if (name_length > 3 && strcmp(path + path_length - 3, ".pq") == 0) {
+		name_length -= 3;
+	}
 	char *name = malloc(sizeof(char) * (name_length + 1));
 	memcpy(name, path + begin_name_index, name_length);
 	name[name_length] = '\0';
 	return name;
 }
 
-void read_file(FILE *file, char **data) {
-	fseek(file, 0, SEEK_END);
-	fpos_t pos;
-	fgetpos(file, &pos);
-	int size = pos.__pos;
+// File in the working directory a dump of the module at path is written
+// to, like hello.ll for ./res/hello.pq
+char *dump_path(char *path, char *extension) {
+	char *name = path_to_name(path);
+	char *dump = malloc(strlen(name) + strlen(extension) + 1);
+	sprintf(dump, "%s%s", name, extension);
+	free(name);
+	return dump;
+}
 
-	*data = malloc((size + 1) * sizeof(char));
+// Opens the dump of the module at path for writing
+FILE *open_dump(char *path, char *extension) {
+	char *dump = dump_path(path, extension);
+	FILE *file = fopen(dump, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Epic fail: unable to write %s: %s\n", dump, strerror(errno));
+		exit(1);
+	}
+	free(dump);
+	return file;
+}
 
-	rewind(file);
-	fread(*data, sizeof(char), size, file);
-	(*data)[size] = '\0';
+static size_t mapped_length(size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (size / page + 1) * page;
 }
 
-void read_file_from_path(char *path, char **data) {
-	FILE *file = fopen(path, "r");
-	if (file == NULL) {
-		perror("Unable open file");
+// Reads files that can't be mapped, like pipes, into an anonymous mapping so
+// they can be released the same way
+static size_t read_stream(int fd, char **data) {
+	size_t size = 0;
+	size_t capacity = 4096;
+	char *buffer = malloc(capacity);
+	ssize_t n;
+	while ((n = read(fd, buffer + size, capacity - size)) > 0) {
+		size += n;
+		if (size == capacity) {
+			capacity *= 2;
+			buffer = realloc(buffer, capacity);
+		}
+	}
+
+	*data = mmap(NULL, mapped_length(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (*data == MAP_FAILED) {
+		perror("Unable to read file");
+		exit(1);
 	}
-	read_file(file, data);
-	fclose(file);
+	memcpy(*data, buffer, size);
+	mprotect(*data, mapped_length(size), PROT_READ);
+	free(buffer);
+	return size;
+}
+
+// Maps the file read only with at least one zero byte after it, so the
+// scanner's '\0' terminator holds without copying the file. The file is
+// mapped over an anonymous mapping one page larger than needed, whose
+// pages read as zeros past the end of the file.
+size_t read_file_from_path(char *path, char **data) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Unable to open file %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		size_t size = read_stream(fd, data);
+		close(fd);
+		return size;
+	}
+
+	size_t size = st.st_size;
+	char *base = mmap(NULL, mapped_length(size), PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED ||
+		(size > 0 && mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+		fprintf(stderr, "Unable to map file %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	madvise(base, size, MADV_SEQUENTIAL);
+	close(fd);
+
+	*data = base;
+	return size;
+}
+
+void release_file(char *data, size_t size) {
+	munmap(data, mapped_length(size));
 }
@@ -0,0 +1,257 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interface.h"
+#include "common.h"
+#include "compilation.h"
+#include "list.h"
+
+// Layout, integers are little endian u32 and strings are a length followed
+// by the bytes:
+//
+//   "PQI1" imports {path} functions {flags name type parameters {...}}
+//
+// Types are encoded recursively, 'v' name for values, 'p' type for
+// pointers and 'a' length type for arrays.
+#define INTERFACE_MAGIC "PQI1"
+
+enum {
+	INTERFACE_EXTERNAL = 1,
+	INTERFACE_VARARG = 2,
+	INTERFACE_RETURNS = 4,
+	INTERFACE_RETURNS_POINTER = 8,
+};
+
+typedef struct {
+	Compilation *compilation;
+	Arena *arena;
+	char *p;
+	char *end;
+	bool failed;
+} Reader;
+
+static void write_u32(FILE *file, uint32_t n) {
+	unsigned char bytes[4] = { n, n >> 8, n >> 16, n >> 24 };
+	fwrite(bytes, 1, 4, file);
+}
+
+static void write_string(FILE *file, String string) {
+	write_u32(file, string.length);
+	fwrite(string.p, 1, string.length, file);
+}
+
+static void write_type(FILE *file, TypeInfo *type_info) {
+	switch (type_info->type) {
+		case TYPE_VALUE:
+			fputc('v', file);
+			write_string(file, type_info->value_of);
+			break;
+		case TYPE_POINTER:
+			fputc('p', file);
+			write_type(file, type_info->pointer_to);
+			break;
+		case TYPE_ARRAY:
+			fputc('a', file);
+			write_u32(file, type_info->array.length);
+			write_type(file, type_info->array.of);
+			break;
+	}
+}
+
+void interface_write(AstNode *file_node, char *path) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Epic fail, unable to write interface %s\n", path);
+		exit(1);
+	}
+	fwrite(INTERFACE_MAGIC, 1, 4, file);
+
+	List *nodes = &file_node->as.file.nodes;
+	int imports = 0;
+	int functions = 0;
+	for (int i = 0; i < nodes->length; i++) {
+		AstNode *node = LIST_GET(AstNode *, nodes, i);
+		imports += node->type == AST_IMPORT;
+		functions += node->type == AST_FUNCTION;
+	}
+
+	write_u32(file, imports);
+	for (int i = 0; i < nodes->length; i++) {
+		AstNode *node = LIST_GET(AstNode *, nodes, i);
+		if (node->type == AST_IMPORT) {
+			write_string(file, node->as.import.path);
+		}
+	}
+
+	write_u32(file, functions);
+	for (int i = 0; i < nodes->length; i++) {
+		AstNode *node = LIST_GET(AstNode *, nodes, i);
+		if (node->type != AST_FUNCTION) {
+			continue;
+		}
+		Function *fn = &node->as.fn;
+		int flags = 0;
+		flags |= fn->external ? INTERFACE_EXTERNAL : 0;
+		flags |= fn->vararg ? INTERFACE_VARARG : 0;
+		flags |= fn->type != NULL ? INTERFACE_RETURNS : 0;
+		flags |= fn->type != NULL && fn->type->pointer ? INTERFACE_RETURNS_POINTER : 0;
+		fputc(flags, file);
+		write_string(file, fn->name);
+		if (fn->type != NULL) {
+			write_string(file, fn->type->name);
+		}
+		write_u32(file, fn->parameters.length);
+		for (int j = 0; j < fn->parameters.length; j++) {
+			Parameter *parameter = &LIST_GET(AstNode *, &fn->parameters, j)->as.parameter;
+			fputc(parameter->rest, file);
+			write_string(file, parameter->name);
+			write_type(file, parameter->type_info);
+		}
+	}
+
+	if (fclose(file) != 0) {
+		fprintf(stderr, "Epic fail, unable to write interface %s\n", path);
+		exit(1);
+	}
+}
+
+static bool has(Reader *reader, size_t size) {
+	if (reader->failed || (size_t)(reader->end - reader->p) < size) {
+		reader->failed = true;
+		return false;
+	}
+	return true;
+}
+
+static int read_byte(Reader *reader) {
+	if (!has(reader, 1)) {
+		return 0;
+	}
+	return (unsigned char)*reader->p++;
+}
+
+static uint32_t read_u32(Reader *reader) {
+	if (!has(reader, 4)) {
+		return 0;
+	}
+	unsigned char *bytes = (unsigned char *)reader->p;
+	reader->p += 4;
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+// Strings point into the mapped interface, like names point into sources
+static String read_string(Reader *reader) {
+	String string = { .p = NULL, .length = 0 };
+	uint32_t length = read_u32(reader);
+	if (!has(reader, length)) {
+		return string;
+	}
+	string.p = reader->p;
+	string.length = length;
+	reader->p += length;
+	return string;
+}
+
+static TypeInfo *read_type(Reader *reader) {
+	Types *types = &reader->compilation->types;
+	switch (read_byte(reader)) {
+		case 'v': {
+			String name = read_string(reader);
+			return reader->failed ? NULL : type_value(types, name);
+		}
+		case 'p': {
+			TypeInfo *to = read_type(reader);
+			return to == NULL ? NULL : type_pointer(types, to);
+		}
+		case 'a': {
+			int length = read_u32(reader);
+			TypeInfo *of = read_type(reader);
+			return of == NULL ? NULL : type_array(types, of, length);
+		}
+		default:
+			reader->failed = true;
+			return NULL;
+	}
+}
+
+static AstNode *create_node(Reader *reader, AstType type) {
+	AstNode *node = arena_alloc(reader->arena, sizeof(AstNode));
+	node->type = type;
+	node->type_info = NULL;
+	node->backend_ref = NULL;
+	return node;
+}
+
+static AstNode *read_function(Reader *reader) {
+	AstNode *node = create_node(reader, AST_FUNCTION);
+	Function *fn = &node->as.fn;
+	int flags = read_byte(reader);
+	fn->name = read_string(reader);
+	fn->symbol = NULL;
+	fn->external = flags & INTERFACE_EXTERNAL;
+	fn->vararg = flags & INTERFACE_VARARG;
+	fn->globals = false;
+	fn->scope = NULL;
+	fn->statements.elements = NULL;
+	fn->statements.length = 0;
+	fn->type = NULL;
+	if (flags & INTERFACE_RETURNS) {
+		fn->type = arena_alloc(reader->arena, sizeof(Type));
+		fn->type->pointer = flags & INTERFACE_RETURNS_POINTER;
+		fn->type->name = read_string(reader);
+	}
+
+	list_init(&fn->parameters, sizeof(AstNode *));
+	int parameters = read_u32(reader);
+	for (int i = 0; i < parameters && !reader->failed; i++) {
+		AstNode *parameter_node = create_node(reader, AST_PARAMETER);
+		Parameter *parameter = &parameter_node->as.parameter;
+		parameter->rest = read_byte(reader);
+		parameter->name = read_string(reader);
+		parameter->type_info = read_type(reader);
+		if (reader->failed) {
+			break;
+		}
+		parameter->symbol = symbol_intern(&reader->compilation->symbols, parameter->name);
+		list_add(&fn->parameters, &parameter_node);
+	}
+	return node;
+}
+
+// Returns NULL if data isn't a valid interface
+AstNode *interface_read(Compilation *compilation, Arena *arena, char *path, char *data, size_t size) {
+	Reader reader = { compilation, arena, data, data + size, false };
+	if (!has(&reader, 4) || memcmp(data, INTERFACE_MAGIC, 4) != 0) {
+		return NULL;
+	}
+	reader.p += 4;
+
+	AstNode *file_node = create_node(&reader, AST_FILE);
+	file_node->as.file.scope = NULL;
+	file_node->as.file.path = path;
+	file_node->as.file.module = symbol_intern(&compilation->symbols, STRING(path));
+	file_node->as.file.source = NULL;
+	List *nodes = &file_node->as.file.nodes;
+	list_init(nodes, sizeof(AstNode *));
+
+	int imports = read_u32(&reader);
+	for (int i = 0; i < imports && !reader.failed; i++) {
+		AstNode *node = create_node(&reader, AST_IMPORT);
+		node->as.import.path = read_string(&reader);
+		node->as.import.file_node = NULL;
+		list_add(nodes, &node);
+	}
+
+	int functions = read_u32(&reader);
+	for (int i = 0; i < functions && !reader.failed; i++) {
+		AstNode *node = read_function(&reader);
+		list_add(nodes, &node);
+	}
+
+	if (reader.failed || reader.p != reader.end) {
+		free(nodes->elements);
+		return NULL;
+	}
+	return file_node;
+}
@@ -0,0 +1,14 @@
+#ifndef PENQUIN_INTERFACE_H
+#define PENQUIN_INTERFACE_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "parser.h"
+
+// Interfaces hold what importers need from a module: its imports and the
+// signatures of its functions. Reading one gives a file node with only
+// those, so a module that isn't compiled doesn't need to be parsed.
+AstNode *interface_read(Compilation *compilation, Arena *arena, char *path, char *data, size_t size);
+void     interface_write(AstNode *file_node, char *path);
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+#include "jit.h"
+#include "codegen.h"
+#include "common.h"
+#include "compilation.h"
+#include "list.h"
+#include "module.h"
+
+struct Jit {
+	Compilation *compilation;
+	LLVMOrcLLJITRef jit;
+	LLVMOrcJITDylibRef dylib;
+	// Lazy compilation calls every function through a stub that compiles
+	// it the first time
+	LLVMOrcLazyCallThroughManagerRef call_through;
+	LLVMOrcIndirectStubsManagerRef stubs;
+	List aliases; // LLVMOrcCSymbolAliasMapPair, function -> its body
+};
+
+static void check(LLVMErrorRef error, char *what) {
+	if (error != NULL) {
+		char *message = LLVMGetErrorMessage(error);
+		fprintf(stderr, "Epic fail: %s: %s\n", what, message);
+		LLVMDisposeErrorMessage(message);
+		fail();
+	}
+}
+
+static LLVMErrorRef optimize(void *context, LLVMModuleRef module) {
+	Compilation *compilation = context;
+	size_t length;
+	const char *name = LLVMGetModuleIdentifier(module, &length);
+	Timer timer = timer_start(&compilation->timings);
+	LLVMTargetMachineRef target_machine = create_target_machine(compilation);
+	optimize_module(module, target_machine, compilation);
+	LLVMDisposeTargetMachine(target_machine);
+	timer_stop(&compilation->timings, timer, "optimize", name, NULL);
+	return NULL;
+}
+
+// Modules are optimized when the JIT compiles them, so with lazy
+// compilation only the functions that are called are optimized
+static LLVMErrorRef transform(void *context, LLVMOrcThreadSafeModuleRef *module, LLVMOrcMaterializationResponsibilityRef responsibility) {
+	return LLVMOrcThreadSafeModuleWithModuleDo(*module, optimize, context);
+}
+
+static void delete_body(LLVMValueRef function) {
+	for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block != NULL; block = LLVMGetNextBasicBlock(block)) {
+		for (LLVMValueRef instruction = LLVMGetFirstInstruction(block); instruction != NULL; instruction = LLVMGetNextInstruction(instruction)) {
+			LLVMTypeRef type = LLVMTypeOf(instruction);
+			if (LLVMGetTypeKind(type) != LLVMVoidTypeKind) {
+				LLVMReplaceAllUsesWith(instruction, LLVMGetUndef(type));
+			}
+		}
+	}
+	LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function);
+	while (block != NULL) {
+		LLVMValueRef instruction = LLVMGetFirstInstruction(block);
+		while (instruction != NULL) {
+			LLVMValueRef next = LLVMGetNextInstruction(instruction);
+			LLVMInstructionEraseFromParent(instruction);
+			instruction = next;
+		}
+		block = LLVMGetNextBasicBlock(block);
+	}
+	while ((block = LLVMGetFirstBasicBlock(function)) != NULL) {
+		LLVMDeleteBasicBlock(block);
+	}
+	LLVMSetLinkage(function, LLVMExternalLinkage);
+}
+
+// Declarations and private globals only used by the bodies that were
+// deleted
+static void delete_unused(LLVMModuleRef module) {
+	LLVMValueRef function = LLVMGetFirstFunction(module);
+	while (function != NULL) {
+		LLVMValueRef next = LLVMGetNextFunction(function);
+		if (LLVMIsDeclaration(function) && LLVMGetFirstUse(function) == NULL) {
+			LLVMDeleteFunction(function);
+		}
+		function = next;
+	}
+	LLVMValueRef global = LLVMGetFirstGlobal(module);
+	while (global != NULL) {
+		LLVMValueRef next = LLVMGetNextGlobal(global);
+		LLVMLinkage linkage = LLVMGetLinkage(global);
+		bool local = linkage == LLVMInternalLinkage || linkage == LLVMPrivateLinkage;
+		if ((local || LLVMIsDeclaration(global)) && LLVMGetFirstUse(global) == NULL) {
+			LLVMDeleteGlobal(global);
+		}
+		global = next;
+	}
+}
+
+// Deletes the bodies of functions[start..end) from module
+static void delete_bodies(LLVMModuleRef module, char **functions, int start, int end) {
+	for (int i = start; i < end; i++) {
+		delete_body(LLVMGetNamedFunction(module, functions[i]));
+	}
+	delete_unused(module);
+}
+
+// The body of the only function in module is renamed, callers go through a
+// lazy reexport with the function's name
+static void add_lazy_function(Jit *jit, LLVMModuleRef module, char *name, LLVMOrcThreadSafeContextRef context) {
+	LLVMValueRef body = LLVMGetNamedFunction(module, name);
+	char *body_name = malloc(strlen(name) + 6);
+	sprintf(body_name, "%s.body", name);
+	LLVMSetValueName2(body, body_name, strlen(body_name));
+	LLVMSetLinkage(body, LLVMExternalLinkage);
+
+	LLVMJITSymbolFlags flags = { .GenericFlags = LLVMJITSymbolGenericFlagsExported | LLVMJITSymbolGenericFlagsCallable, .TargetFlags = 0 };
+	LLVMOrcCSymbolAliasMapPair alias = {
+		.Name = LLVMOrcLLJITMangleAndIntern(jit->jit, name),
+		.Entry = { .Name = LLVMOrcLLJITMangleAndIntern(jit->jit, body_name), .Flags = flags },
+	};
+	list_add(&jit->aliases, &alias);
+	check(LLVMOrcLLJITAddLLVMIRModule(jit->jit, jit->dylib, LLVMOrcCreateNewThreadSafeModule(module, context)), name);
+	free(body_name);
+}
+
+// module has the bodies of functions[start..end) and is halved until each
+// part has one. The clone gets the second half and the first half keeps the
+// global variables, so a body is copied once per halving instead of once
+// per function.
+static void split_module(Jit *jit, LLVMModuleRef module, char **functions, int start, int end, LLVMOrcThreadSafeContextRef context) {
+	if (end - start == 1) {
+		add_lazy_function(jit, module, functions[start], context);
+		return;
+	}
+	int middle = start + (end - start) / 2;
+	LLVMModuleRef second = LLVMCloneModule(module);
+	for (LLVMValueRef global = LLVMGetFirstGlobal(second); global != NULL; global = LLVMGetNextGlobal(global)) {
+		LLVMLinkage linkage = LLVMGetLinkage(global);
+		if (linkage != LLVMInternalLinkage && linkage != LLVMPrivateLinkage) {
+			LLVMSetInitializer(global, NULL);
+		}
+	}
+	delete_bodies(module, functions, middle, end);
+	delete_bodies(second, functions, start, middle);
+	split_module(jit, module, functions, start, middle, context);
+	split_module(jit, second, functions, middle, end, context);
+}
+
+// Splits module into a module per function, so a body is only compiled
+// when it is first called
+static void add_lazy_module(Jit *jit, LLVMModuleRef module, LLVMOrcThreadSafeContextRef context) {
+	List functions;
+	list_init(&functions, sizeof(char *));
+	for (LLVMValueRef function = LLVMGetFirstFunction(module); function != NULL; function = LLVMGetNextFunction(function)) {
+		if (!LLVMIsDeclaration(function)) {
+			char *name = cstring_duplicate((char *)LLVMGetValueName(function));
+			list_add(&functions, &name);
+		}
+	}
+	if (functions.length == 0) {
+		check(LLVMOrcLLJITAddLLVMIRModule(jit->jit, jit->dylib, LLVMOrcCreateNewThreadSafeModule(module, context)), "unable to add a module");
+	} else {
+		split_module(jit, module, functions.elements, 0, functions.length, context);
+	}
+	for (int i = 0; i < functions.length; i++) {
+		free(LIST_GET(char *, &functions, i));
+	}
+	free(functions.elements);
+}
+
+void jit_add(Jit *jit, LLVMModuleRef module, LLVMOrcThreadSafeContextRef context) {
+	if (!jit->compilation->options.lazy) {
+		check(LLVMOrcLLJITAddLLVMIRModule(jit->jit, jit->dylib, LLVMOrcCreateNewThreadSafeModule(module, context)), "unable to add a module");
+		return;
+	}
+
+	add_lazy_module(jit, module, context);
+	LLVMOrcMaterializationUnitRef reexports = LLVMOrcLazyReexports(jit->call_through, jit->stubs, jit->dylib, jit->aliases.elements, jit->aliases.length);
+	check(LLVMOrcJITDylibDefine(jit->dylib, reexports), "unable to define the lazy functions");
+	jit->aliases.length = 0;
+}
+
+void jit_add_module(Jit *jit, Module *module) {
+	Compilation *compilation = jit->compilation;
+	ModuleGraph *graph = &compilation->graph;
+	if (module->object != NULL) {
+		LLVMMemoryBufferRef buffer;
+		char *message;
+		if (LLVMCreateMemoryBufferWithContentsOfFile(module->object, &buffer, &message)) {
+			fprintf(stderr, "Epic fail: unable to read %s: %s\n", module->object, message);
+			fail();
+		}
+		check(LLVMOrcLLJITAddObjectFile(jit->jit, jit->dylib, buffer), module->path);
+		return;
+	}
+
+	memory_enter(&compilation->memory, MEMORY_CODEGEN);
+	LLVMOrcThreadSafeContextRef context = LLVMOrcCreateNewThreadSafeContext();
+	LLVMContextRef llvm_context = LLVMOrcThreadSafeContextGetContext(context);
+	LLVMModuleRef llvm_module;
+	if (module->std != NULL) {
+		llvm_module = std_load(module->std, llvm_context);
+	} else {
+		llvm_module = build_module(compilation, llvm_context, module->file_node, module->dir, module->path, module == graph->main);
+		verify_module(llvm_module, compilation);
+	}
+	jit_add(jit, llvm_module, context);
+	LLVMOrcDisposeThreadSafeContext(context);
+}
+
+Jit *jit_create(Compilation *compilation) {
+	Jit *jit = malloc(sizeof(Jit));
+	jit->compilation = compilation;
+	list_init(&jit->aliases, sizeof(LLVMOrcCSymbolAliasMapPair));
+
+	LLVMOrcLLJITBuilderRef builder = LLVMOrcCreateLLJITBuilder();
+	LLVMOrcJITTargetMachineBuilderRef target_machine_builder = LLVMOrcJITTargetMachineBuilderCreateFromTargetMachine(create_target_machine(compilation));
+	LLVMOrcLLJITBuilderSetJITTargetMachineBuilder(builder, target_machine_builder);
+	check(LLVMOrcCreateLLJIT(&jit->jit, builder), "unable to create the JIT");
+	jit->dylib = LLVMOrcLLJITGetMainJITDylib(jit->jit);
+	LLVMOrcIRTransformLayerSetTransform(LLVMOrcLLJITGetIRTransformLayer(jit->jit), transform, compilation);
+
+	// extern functions come from the process, like libc
+	LLVMOrcDefinitionGeneratorRef process_symbols;
+	check(LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(&process_symbols, LLVMOrcLLJITGetGlobalPrefix(jit->jit), NULL, NULL), "unable to search the process");
+	LLVMOrcJITDylibAddGenerator(jit->dylib, process_symbols);
+
+	const char *triple = LLVMOrcLLJITGetTripleString(jit->jit);
+	jit->stubs = NULL;
+	jit->call_through = NULL;
+	if (compilation->options.lazy) {
+		jit->stubs = LLVMOrcCreateLocalIndirectStubsManager(triple);
+		check(LLVMOrcCreateLocalLazyCallThroughManager(triple, LLVMOrcLLJITGetExecutionSession(jit->jit), 0, &jit->call_through), "unable to create lazy call through");
+	}
+	return jit;
+}
+
+void jit_destroy(Jit *jit) {
+	check(LLVMOrcDisposeLLJIT(jit->jit), "unable to dispose the JIT");
+	if (jit->compilation->options.lazy) {
+		LLVMOrcDisposeLazyCallThroughManager(jit->call_through);
+		LLVMOrcDisposeIndirectStubsManager(jit->stubs);
+	}
+	free(jit->aliases.elements);
+	free(jit);
+}
+
+// Looking up a symbol compiles what it needs that isn't compiled yet
+void *jit_lookup(Jit *jit, char *name) {
+	LLVMOrcExecutorAddress address;
+	Timer timer = timer_start(&jit->compilation->timings);
+	check(LLVMOrcLLJITLookup(jit->jit, &address, name), name);
+	timer_stop(&jit->compilation->timings, timer, "jit", NULL, name);
+	return (void *)address;
+}
+
+int jit_run(Compilation *compilation) {
+	Jit *jit = jit_create(compilation);
+	ModuleGraph *graph = &compilation->graph;
+	for (int i = 0; i < graph->order.length; i++) {
+		jit_add_module(jit, LIST_GET(Module *, &graph->order, i));
+	}
+
+	int (*main_function)(void) = jit_lookup(jit, "main");
+	int result = main_function();
+	fflush(stdout);
+	jit_destroy(jit);
+	return result;
+}
@@ -0,0 +1,23 @@
+#ifndef PENQUIN_JIT_H
+#define PENQUIN_JIT_H
+
+#include <llvm-c/Orc.h>
+#include "module.h"
+#include "penquin.h"
+
+// A JIT session, modules added to it stay until it is destroyed
+typedef struct Jit Jit;
+
+// Takes ownership of module, generated in context
+void  jit_add(Jit *jit, LLVMModuleRef module, LLVMOrcThreadSafeContextRef context);
+// Adds the object of module if it has one, or generates it
+void  jit_add_module(Jit *jit, Module *module);
+Jit  *jit_create(Compilation *compilation);
+void  jit_destroy(Jit *jit);
+void *jit_lookup(Jit *jit, char *name);
+// Runs main of the checked module graph of compilation in process with an
+// ORC JIT, from the module objects when they are emitted or else from
+// modules generated here
+int   jit_run(Compilation *compilation);
+
+#endif
@@ -1,12 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "list.h"
+#include "memory.h"
 #include "string.h"
 
 #define LIST_DEFAULT_LENGTH 12
 
 List *list_init(List *list, size_t element_size) {
     list->elements = malloc(LIST_DEFAULT_LENGTH * element_size);
+	memory_count(MEMORY_LISTS, LIST_DEFAULT_LENGTH * element_size);
     if (list->elements == NULL) {
         return NULL;
     }
@@ -28,6 +30,7 @@ void list_add(List *list, void *ref) {
 			fprintf(stderr, "Unable to reallocate list.");
 			exit(1);
         }
+        memory_count(MEMORY_LISTS, (new_capacity - list->capacity) * list->element_size);
         list->elements = new_elements;
         list->capacity = new_capacity;
     }
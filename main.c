@@ -1,101 +1,143 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <libgen.h>
+#include <string.h>
 #include <unistd.h>
-#include <llvm-c/Linker.h>
-#include <llvm-c/Analysis.h>
 #include "common.h"
-#include "table.h"
-#include "token.h"
-#include "parser.h"
-#include "codegen.h"
-#include "resolver.h"
-#include "typechecker.h"
+#include "penquin.h"
 
-
-AstNode *build_file_node(char *path, char *buffer) {
-	List tokens;
-	list_init(&tokens, sizeof(Token));
-	scan(buffer, &tokens);
-#ifdef DEBUG
-	printf("number of tokens: %d\n", tokens.length);
-	for (int i = 0; i < tokens.length; i++) {
-		Token t = ((Token *)tokens.elements)[i];
-		printf("token %s\n", token_type_to_string(t.type));
-	}
-#endif
-	return parse_file(path, &tokens);
+static void usage() {
+	printf("Usage: penquin [run|repl] [--lazy] [--huge-pages] [--jobs=N] [--cache-dir=DIR] [--cache-size=MB] [--std-dir=DIR] [--emit-std=DIR] [-O0|-O1|-O2|-O3|-Os] [--passes=PIPELINE] [--whole-program] [-march=CPU|-mcpu=CPU] [-mattr=FEATURES] [--time-report] [--trace=FILE] [--mem-report] [--dump-tokens] [--dump-ast] [--emit-llvm] [--emit-asm] [--verify] [--output=FILE] file\n");
+	exit(1);
 }
 
-void traverse_imports(Table *file_node_table, AstNode *file_node, char *dir) {
-	List *nodes = &file_node->as.file.nodes;
-	for (int i = 0; i < nodes->length; i++) {
-		AstNode *node = LIST_GET(AstNode *, nodes, i);
-		if (node->type == AST_IMPORT) {
-			char *import_path = resolve_module_path(dir, node->as.import.path);
-			char *import_dir = get_directory(import_path);
-
-#ifdef DEBUG
-			printf("import_path: %s\n", import_path);
-			printf("import_dir: %s\n", import_dir);
-#endif
-
-			AstNode *import_module = table_get(file_node_table, STRING(import_path));
-			if (import_module != NULL) {
-				free(import_path);
-				free(import_dir);
-				continue;
+int main(int argc, char **argv) {
+	char *path = NULL;
+	char *emit_std = NULL;
+	char *output = NULL;
+	bool run = argc > 1 && strcmp(argv[1], "run") == 0;
+	bool repl = argc > 1 && strcmp(argv[1], "repl") == 0;
+	PenquinOptions options = {
+		.huge_pages = false,
+		.jobs = 0,
+		.cache_dir = NULL,
+		.cache_limit = (size_t)512 << 20,
+		.std_dir = NULL,
+		.opt_level = '0',
+		.passes = NULL,
+		.whole_program = false,
+		.cpu = NULL,
+		.features = NULL,
+		.lazy = false,
+		.time_report = false,
+		.trace = NULL,
+		.mem_report = false,
+		.dump_tokens = false,
+		.dump_ast = false,
+		.emit_llvm = false,
+		.emit_asm = false,
+		.verify = false,
+	};
+	for (int i = run || repl ? 2 : 1; i < argc; i++) {
+		if (strcmp(argv[i], "--huge-pages") == 0) {
+			options.huge_pages = true;
+		} else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+			options.jobs = atoi(argv[i] + 7);
+			if (options.jobs < 1) {
+				usage();
 			}
-			char *buffer;
-			read_file_from_path(import_path, &buffer);
-
-			AstNode *module = build_file_node(import_path, buffer);
-
-			table_put(file_node_table, STRING(import_path), module);
-			traverse_imports(file_node_table, module, import_dir);
-			resolve(module, import_dir);
-			resolve_types(module);	
-			free(import_dir);
+		} else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+			options.cache_dir = argv[i] + 12;
+		} else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+			long megabytes = atol(argv[i] + 13);
+			if (megabytes < 1) {
+				usage();
+			}
+			options.cache_limit = (size_t)megabytes << 20;
+		} else if (strncmp(argv[i], "--std-dir=", 10) == 0) {
+			options.std_dir = argv[i] + 10;
+		} else if (strncmp(argv[i], "--emit-std=", 11) == 0) {
+			emit_std = argv[i] + 11;
+		} else if (strlen(argv[i]) == 3 && strncmp(argv[i], "-O", 2) == 0 && strchr("0123s", argv[i][2]) != NULL) {
+			options.opt_level = argv[i][2];
+		} else if (strncmp(argv[i], "--passes=", 9) == 0) {
+			options.passes = argv[i] + 9;
+		} else if (strcmp(argv[i], "--whole-program") == 0) {
+			options.whole_program = true;
+		} else if (strncmp(argv[i], "-march=", 7) == 0) {
+			options.cpu = argv[i] + 7;
+		} else if (strncmp(argv[i], "-mcpu=", 6) == 0) {
+			options.cpu = argv[i] + 6;
+		} else if (strncmp(argv[i], "-mattr=", 7) == 0) {
+			options.features = argv[i] + 7;
+		} else if (strcmp(argv[i], "--time-report") == 0) {
+			options.time_report = true;
+		} else if (strncmp(argv[i], "--trace=", 8) == 0) {
+			options.trace = argv[i] + 8;
+		} else if (strcmp(argv[i], "--mem-report") == 0) {
+			options.mem_report = true;
+		} else if (strcmp(argv[i], "--dump-tokens") == 0) {
+			options.dump_tokens = true;
+		} else if (strcmp(argv[i], "--dump-ast") == 0) {
+			options.dump_ast = true;
+		} else if (strcmp(argv[i], "--emit-llvm") == 0) {
+			options.emit_llvm = true;
+		} else if (strcmp(argv[i], "--emit-asm") == 0) {
+			options.emit_asm = true;
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			options.verify = true;
+		} else if (strcmp(argv[i], "--lazy") == 0) {
+			options.lazy = true;
+		} else if (strncmp(argv[i], "--output=", 9) == 0 && argv[i][9] != '\0') {
+			output = argv[i] + 9;
+		} else if (argv[i][0] == '-' || path != NULL) {
+			usage();
+		} else {
+			path = argv[i];
 		}
 	}
-}
-
-int main(int argc, char **argv) {
-	if (argc != 2) {
-		printf("Usage: penquin file\n");
-		exit(1);
+	if (repl) {
+		if (path != NULL) {
+			usage();
+		}
+		Compilation *compilation = penquin_create(&options);
+		penquin_repl(compilation);
+		penquin_destroy(compilation);
+		return 0;
+	}
+	if (path == NULL) {
+		usage();
 	}
 
-	char *name = path_to_name(argv[1]);
-	char *dir = get_directory(argv[1]);
-	
-	char *buffer;
-	read_file_from_path(argv[1], &buffer);
-
-	AstNode *main_file_node = build_file_node(argv[1], buffer);
-
-	Table modules;
-	table_init(&modules);
-	resolver_initialize(&modules);
-
-	traverse_imports(&modules, main_file_node, dir);
-	resolve(main_file_node, dir);
-	resolve_types(main_file_node);
-
-	compiler_initialize(&modules);
-	LLVMModuleRef main_llvm_module = build_module(main_file_node, dir, name, true);
+	// Building std, the std modules it imports are next to it
+	if (emit_std != NULL) {
+		char *dir = get_directory(path);
+		if (options.std_dir == NULL) {
+			options.std_dir = dir;
+		}
+		Compilation *compilation = penquin_create(&options);
+		penquin_emit_std(compilation, path, emit_std);
+		penquin_destroy(compilation);
+		return 0;
+	}
 
-	AstNode **module_list = (AstNode **) table_get_all(&modules);
-	for (int i = 0; i < modules.length; i++) {
-		AstNode *file_node = module_list[i];
-		LLVMModuleRef llvm_module = build_module(file_node, dir, file_node->as.file.path, false);
-		LLVMLinkModules2(main_llvm_module, llvm_module);
+	// Running in process with the JIT instead of building test, which is
+	// run once it is built unless another output is given
+	Compilation *compilation = penquin_create(&options);
+	int result = 0;
+	if (run) {
+		result = penquin_run(compilation, path);
+	} else {
+		penquin_compile(compilation, path, output != NULL ? output : "test");
+	}
+	if (options.cache_dir != NULL) {
+		int hits, misses;
+		penquin_cache_stats(compilation, &hits, &misses);
+		fprintf(stderr, "cache: %d hits, %d misses\n", hits, misses);
+	}
+	penquin_destroy(compilation);
+	if (run || output != NULL) {
+		return result;
 	}
-	LLVMVerifyModule(main_llvm_module, LLVMPrintMessageAction, NULL);
-	compile(main_llvm_module, "test");
-#ifdef DEBUG
-	printf("exec:\n\n");
-#endif
 	execl("test", "test", (char *) NULL);
 
 	return 0;
@@ -0,0 +1,86 @@
+#include <malloc.h>
+#include <sys/resource.h>
+#include "memory.h"
+
+static _Thread_local Memory *current_memory = NULL;
+static _Thread_local MemoryPhase current_phase = MEMORY_SETUP;
+
+static char *category_names[MEMORY_CATEGORIES] = {
+	[MEMORY_AST] = "ast",
+	[MEMORY_LISTS] = "lists",
+	[MEMORY_LLVM] = "llvm",
+	[MEMORY_SCOPES] = "scopes",
+	[MEMORY_STRINGS] = "strings",
+	[MEMORY_SYMBOLS] = "symbols",
+	[MEMORY_TABLES] = "tables",
+	[MEMORY_TYPES] = "types",
+};
+
+static char *phase_names[MEMORY_PHASES] = {
+	[MEMORY_SETUP] = "setup",
+	[MEMORY_PARSE] = "parse",
+	[MEMORY_RESOLVE] = "resolve",
+	[MEMORY_TYPECHECK] = "typecheck",
+	[MEMORY_CODEGEN] = "codegen",
+};
+
+void memory_init(Memory *memory, bool enabled) {
+	memory->enabled = enabled;
+	for (int phase = 0; phase < MEMORY_PHASES; phase++) {
+		for (int category = 0; category < MEMORY_CATEGORIES; category++) {
+			atomic_init(&memory->counters[phase][category].bytes, 0);
+			atomic_init(&memory->counters[phase][category].count, 0);
+		}
+	}
+}
+
+void memory_enter(Memory *memory, MemoryPhase phase) {
+	current_memory = memory != NULL && memory->enabled ? memory : NULL;
+	current_phase = phase;
+}
+
+void memory_count(MemoryCategory category, size_t bytes) {
+	if (current_memory == NULL) {
+		return;
+	}
+	MemoryCounter *counter = &current_memory->counters[current_phase][category];
+	atomic_fetch_add_explicit(&counter->bytes, bytes, memory_order_relaxed);
+	atomic_fetch_add_explicit(&counter->count, 1, memory_order_relaxed);
+}
+
+void memory_count_heap(size_t start) {
+	size_t end = memory_heap();
+	if (end > start) {
+		memory_count(MEMORY_LLVM, end - start);
+	}
+}
+
+size_t memory_heap() {
+	if (current_memory == NULL) {
+		return 0;
+	}
+	return mallinfo2().uordblks;
+}
+
+void memory_report(Memory *memory, FILE *file) {
+	fprintf(file, "%-10s %-8s %12s %10s\n", "phase", "category", "bytes", "count");
+	size_t totals[MEMORY_CATEGORIES] = { 0 };
+	for (int phase = 0; phase < MEMORY_PHASES; phase++) {
+		for (int category = 0; category < MEMORY_CATEGORIES; category++) {
+			size_t bytes = atomic_load(&memory->counters[phase][category].bytes);
+			size_t count = atomic_load(&memory->counters[phase][category].count);
+			totals[category] += bytes;
+			if (count > 0) {
+				fprintf(file, "%-10s %-8s %12zu %10zu\n", phase_names[phase], category_names[category], bytes, count);
+			}
+		}
+	}
+	fprintf(file, "\n");
+	for (int category = 0; category < MEMORY_CATEGORIES; category++) {
+		fprintf(file, "%-19s %12zu\n", category_names[category], totals[category]);
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(file, "%-19s %12ld\n", "peak rss", usage.ru_maxrss * 1024);
+}
@@ -0,0 +1,55 @@
+#ifndef PENQUIN_MEMORY_H
+#define PENQUIN_MEMORY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef enum {
+	MEMORY_AST,
+	MEMORY_LISTS,
+	MEMORY_LLVM,
+	MEMORY_SCOPES,
+	MEMORY_STRINGS,
+	MEMORY_SYMBOLS,
+	MEMORY_TABLES,
+	MEMORY_TYPES,
+	MEMORY_CATEGORIES,
+} MemoryCategory;
+
+typedef enum {
+	MEMORY_SETUP,
+	MEMORY_PARSE,
+	MEMORY_RESOLVE,
+	MEMORY_TYPECHECK,
+	MEMORY_CODEGEN,
+	MEMORY_PHASES,
+} MemoryPhase;
+
+typedef struct {
+	atomic_size_t bytes;
+	atomic_size_t count;
+} MemoryCounter;
+
+// Bytes allocated by a compilation per phase and category. Allocations
+// are counted on threads that entered a phase of the compilation.
+typedef struct {
+	bool enabled;
+	MemoryCounter counters[MEMORY_PHASES][MEMORY_CATEGORIES];
+} Memory;
+
+void memory_count(MemoryCategory category, size_t bytes);
+// Counts how much the heap grew since start as LLVM memory. The heap is
+// shared by all threads so this is only exact with one job.
+void memory_count_heap(size_t start);
+// Counts what the calling thread allocates in memory under phase, until
+// it enters another phase. NULL stops counting.
+void memory_enter(Memory *memory, MemoryPhase phase);
+// Heap in use by the process, 0 when the thread isn't counting
+size_t memory_heap();
+void memory_init(Memory *memory, bool enabled);
+// Bytes and counts per phase and category and the peak RSS
+void memory_report(Memory *memory, FILE *file);
+
+#endif
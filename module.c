@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "module.h"
+#include "common.h"
+#include "codegen.h"
+#include "compilation.h"
+#include "interface.h"
+#include "resolver.h"
+#include "token.h"
+#include "typechecker.h"
+
+enum {
+	MODULE_NEW,
+	MODULE_VISITING,
+	MODULE_ORDERED,
+};
+
+static void load_module(void *argument, int worker);
+
+// Writes the tokens of source with their position and text
+static void dump_tokens(char *path, char *source) {
+	FILE *file = open_dump(path, ".tokens");
+	TokenStream stream;
+	token_stream_init(&stream, source);
+	Token token;
+	do {
+		token = token_next(&stream);
+		int line, col;
+		token_position(&stream, token, &line, &col);
+		fprintf(file, "%d:%d %s %.*s\n", line, col, token_type_to_string(token.type), token.length, source + token.offset);
+	} while (token.type != TOKEN_EOF);
+	free(stream.newlines.elements);
+	fclose(file);
+}
+
+static AstNode *build_file_node(Compilation *compilation, Arena *arena, char *path, char *buffer) {
+	if (compilation->options.dump_tokens) {
+		dump_tokens(path, buffer);
+	}
+	Timer timer = timer_start(&compilation->timings);
+	AstNode *file_node = parse_file(compilation, arena, path, buffer);
+	timer_stop(&compilation->timings, timer, "parse", path, NULL);
+	if (compilation->options.dump_ast) {
+		FILE *file = open_dump(path, ".ast");
+		print_ast(file, file_node);
+		fclose(file);
+	}
+	return file_node;
+}
+
+// Takes ownership of path, must be called with the graph locked
+static Module *add_module(ModuleGraph *graph, char *path) {
+	Module *module = table_get(&graph->modules, STRING(path));
+	if (module != NULL) {
+		free(path);
+		return module;
+	}
+
+	module = malloc(sizeof(Module));
+	module->path = path;
+	module->dir = get_directory(path);
+	module->file_node = NULL;
+	module->stub = false;
+	module->source = NULL;
+	module->size = 0;
+	module->object = NULL;
+	module->cached = false;
+	module->std = NULL;
+	module->llvm_module = NULL;
+	module->graph = graph;
+	list_init(&module->imports, sizeof(Module *));
+	list_init(&module->importers, sizeof(Module *));
+	module->pending = 0;
+	module->checked = false;
+	module->mark = MODULE_NEW;
+	table_put(&graph->modules, STRING(module->path), module);
+	pool_submit(&graph->compilation->pool, load_module, module);
+	return module;
+}
+
+// With a cache, modules are read from their interface when the source
+// hasn't changed since it was written, and parsed only if they need to be
+// compiled
+static void hash_interface(Module *module, char *data, size_t size) {
+	hash_init(&module->interface_hash);
+	hash_update(&module->interface_hash, module->path, strlen(module->path) + 1);
+	hash_update(&module->interface_hash, data, size);
+}
+
+static void read_interface(Module *module, Arena *arena) {
+	Compilation *compilation = module->graph->compilation;
+	hash_init(&module->source_hash);
+	hash_update(&module->source_hash, module->path, strlen(module->path) + 1);
+	hash_update(&module->source_hash, module->source, module->size);
+
+	char *interface = cache_path(&compilation->cache, module->source_hash, ".pqi");
+	if (cache_touch(interface)) {
+		Timer timer = timer_start(&compilation->timings);
+		char *data;
+		size_t size = read_file_from_path(interface, &data);
+		module->file_node = interface_read(compilation, arena, module->path, data, size);
+		if (module->file_node == NULL) {
+			release_file(data, size);
+		} else {
+			hash_interface(module, data, size);
+		}
+		timer_stop(&compilation->timings, timer, "interface", module->path, NULL);
+	}
+
+	if (module->file_node != NULL) {
+		module->stub = true;
+	} else {
+		module->file_node = build_file_node(compilation, arena, module->path, module->source);
+		Timer timer = timer_start(&compilation->timings);
+		char *temporary = cache_temporary(interface);
+		interface_write(module->file_node, temporary);
+		char *data;
+		size_t size = read_file_from_path(temporary, &data);
+		hash_interface(module, data, size);
+		release_file(data, size);
+		cache_store(temporary, interface);
+		free(temporary);
+		timer_stop(&compilation->timings, timer, "interface", module->path, NULL);
+	}
+	free(interface);
+}
+
+// Embedded std modules are used from their interface, unless std is
+// compiled from the source in std_dir
+static void read_std(Module *module, Arena *arena) {
+	Compilation *compilation = module->graph->compilation;
+	StdModule *std = module->std;
+	hash_init(&module->source_hash);
+	hash_update(&module->source_hash, module->path, strlen(module->path) + 1);
+	hash_update(&module->source_hash, std->bitcode, std->bitcode_end - std->bitcode);
+
+	hash_interface(module, std->interface, std->interface_end - std->interface);
+	module->file_node = interface_read(compilation, arena, module->path, std->interface, std->interface_end - std->interface);
+	if (module->file_node == NULL) {
+		fprintf(stderr, "Epic fail: embedded interface of %s is broken\n", module->path);
+		exit(1);
+	}
+	module->stub = true;
+}
+
+static char *source_path(Module *module) {
+	char *std_dir = module->graph->compilation->options.std_dir;
+	if (std_dir == NULL || strncmp(module->path, "std:", 4) != 0) {
+		return cstring_duplicate(module->path);
+	}
+	char *path = malloc(strlen(std_dir) + strlen(module->path) + 1);
+	sprintf(path, "%s/%s.pq", std_dir, module->path + 4);
+	return path;
+}
+
+static void load_module(void *argument, int worker) {
+	Module *module = argument;
+	ModuleGraph *graph = module->graph;
+	Compilation *compilation = graph->compilation;
+	Arena *arena = &compilation->arenas[worker];
+	memory_enter(&compilation->memory, MEMORY_PARSE);
+
+	if (compilation->options.std_dir == NULL && strncmp(module->path, "std:", 4) == 0) {
+		module->std = std_module(module->path);
+		if (module->std == NULL) {
+			fprintf(stderr, "Epic fail: no std module %s\n", module->path);
+			exit(1);
+		}
+	}
+
+	if (module->std != NULL) {
+		read_std(module, arena);
+	} else {
+		Timer timer = timer_start(&compilation->timings);
+		char *path = source_path(module);
+		module->size = read_file_from_path(path, &module->source);
+		free(path);
+		timer_stop(&compilation->timings, timer, "read", module->path, NULL);
+		if (compilation->options.cache_dir != NULL) {
+			read_interface(module, arena);
+		} else {
+			module->file_node = build_file_node(compilation, arena, module->path, module->source);
+		}
+	}
+
+	List *nodes = &module->file_node->as.file.nodes;
+	for (int i = 0; i < nodes->length; i++) {
+		AstNode *node = LIST_GET(AstNode *, nodes, i);
+		if (node->type != AST_IMPORT) {
+			continue;
+		}
+		char *import_path = resolve_module_path(module->dir, node->as.import.path);
+		pthread_mutex_lock(&graph->lock);
+		Module *import = add_module(graph, import_path);
+		list_add(&module->imports, &import);
+		pthread_mutex_unlock(&graph->lock);
+	}
+}
+
+static void report_cycle(List *stack, Module *module) {
+	fprintf(stderr, "Epic fail: import cycle ");
+	int i = stack->length - 1;
+	while (LIST_GET(Module *, stack, i) != module) {
+		i--;
+	}
+	for (; i < stack->length; i++) {
+		fprintf(stderr, "%s -> ", LIST_GET(Module *, stack, i)->path);
+	}
+	fprintf(stderr, "%s\n", module->path);
+	exit(1);
+}
+
+// Depth first from main in source order, so the order doesn't depend on
+// which thread parsed what first
+static void order_module(ModuleGraph *graph, Module *module, List *stack) {
+	if (module->mark == MODULE_ORDERED) {
+		return;
+	}
+	if (module->mark == MODULE_VISITING) {
+		report_cycle(stack, module);
+	}
+	module->mark = MODULE_VISITING;
+	list_add(stack, &module);
+	for (int i = 0; i < module->imports.length; i++) {
+		order_module(graph, LIST_GET(Module *, &module->imports, i), stack);
+	}
+	stack->length--;
+	module->mark = MODULE_ORDERED;
+	list_add(&graph->order, &module);
+}
+
+void module_graph_init(ModuleGraph *graph, Compilation *compilation) {
+	graph->compilation = compilation;
+	pthread_mutex_init(&graph->lock, NULL);
+	table_init(&graph->modules);
+	list_init(&graph->order, sizeof(Module *));
+	graph->main = NULL;
+	graph->checked = 0;
+	table_init(&graph->imports);
+	table_init(&graph->references);
+}
+
+// Reads and parses path and everything it imports that isn't in the graph
+// yet, files are parsed on the pool as soon as an import of them is seen
+Module *module_graph_add(ModuleGraph *graph, char *path) {
+	Compilation *compilation = graph->compilation;
+	pthread_mutex_lock(&graph->lock);
+	Module *module = add_module(graph, cstring_duplicate(path));
+	pthread_mutex_unlock(&graph->lock);
+	pool_wait(&compilation->pool);
+
+	List stack;
+	list_init(&stack, sizeof(Module *));
+	order_module(graph, module, &stack);
+	free(stack.elements);
+	return module;
+}
+
+void module_graph_load(ModuleGraph *graph, char *path) {
+	graph->main = module_graph_add(graph, path);
+}
+
+static void parse_stub(void *argument, int worker) {
+	Module *module = argument;
+	Compilation *compilation = module->graph->compilation;
+	memory_enter(&compilation->memory, MEMORY_PARSE);
+	module->file_node = build_file_node(compilation, &compilation->arenas[worker], module->path, module->source);
+	module->stub = false;
+}
+
+// Parses the modules that were only read from their interface but have to
+// be compiled after all
+void module_graph_parse_stubs(ModuleGraph *graph) {
+	Pool *pool = &graph->compilation->pool;
+	for (int i = 0; i < graph->order.length; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		if (module->stub && !module->cached && module->std == NULL) {
+			pool_submit(pool, parse_stub, module);
+		}
+	}
+	pool_wait(pool);
+}
+
+static void check_module(void *argument, int worker) {
+	Module *module = argument;
+	ModuleGraph *graph = module->graph;
+	memory_enter(&graph->compilation->memory, MEMORY_TYPECHECK);
+
+	Timer timer = timer_start(&graph->compilation->timings);
+	resolve_types(graph->compilation, module->file_node);
+	timer_stop(&graph->compilation->timings, timer, "typecheck", module->path, NULL);
+
+	pthread_mutex_lock(&graph->lock);
+	module->checked = true;
+	for (int i = 0; i < module->importers.length; i++) {
+		Module *importer = LIST_GET(Module *, &module->importers, i);
+		if (--importer->pending == 0) {
+			pool_submit(&graph->compilation->pool, check_module, importer);
+		}
+	}
+	pthread_mutex_unlock(&graph->lock);
+}
+
+// Resolves and type checks the modules added since the last check. The
+// resolver shares one global scope so it runs serially, type checking only
+// needs the imports checked first so independent modules are checked in
+// parallel.
+void module_graph_check(ModuleGraph *graph) {
+	int first = graph->checked;
+	memory_enter(&graph->compilation->memory, MEMORY_RESOLVE);
+	for (int i = first; i < graph->order.length; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		if (module != graph->main) {
+			table_put(&graph->imports, STRING(module->path), module->file_node);
+		}
+	}
+
+	for (int i = first; i < graph->order.length; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		Timer timer = timer_start(&graph->compilation->timings);
+		resolve(graph->compilation, module->file_node, module->dir);
+		timer_stop(&graph->compilation->timings, timer, "resolve", module->path, NULL);
+		module->pending = 0;
+		for (int j = 0; j < module->imports.length; j++) {
+			Module *import = LIST_GET(Module *, &module->imports, j);
+			list_add(&import->importers, &module);
+			module->pending += !import->checked;
+		}
+	}
+
+	pthread_mutex_lock(&graph->lock);
+	for (int i = first; i < graph->order.length; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		if (module->pending == 0) {
+			pool_submit(&graph->compilation->pool, check_module, module);
+		}
+	}
+	pthread_mutex_unlock(&graph->lock);
+	pool_wait(&graph->compilation->pool);
+	graph->checked = graph->order.length;
+}
+
+void module_graph_free(ModuleGraph *graph) {
+	for (int i = 0; i < graph->order.length; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		free(module->imports.elements);
+		free(module->importers.elements);
+		free(module->path);
+		free(module->object);
+		if (module->llvm_module != NULL) {
+			dispose_module(module->llvm_module);
+		}
+		free(module);
+	}
+	free(graph->order.elements);
+	table_free(&graph->modules);
+	table_free(&graph->imports);
+	int next = 0;
+	TableEntry *entry;
+	while (table_next(&graph->references, &next, &entry)) {
+		free(entry->element);
+	}
+	table_free(&graph->references);
+	pthread_mutex_destroy(&graph->lock);
+}
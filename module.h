@@ -0,0 +1,55 @@
+#ifndef PENQUIN_MODULE_H
+#define PENQUIN_MODULE_H
+
+#include <pthread.h>
+#include <llvm-c/Types.h>
+#include "cache.h"
+#include "list.h"
+#include "parser.h"
+#include "penquin.h"
+#include "std.h"
+#include "table.h"
+
+typedef struct ModuleGraph ModuleGraph;
+
+typedef struct Module {
+	char *path;
+	char *dir;
+	AstNode *file_node;
+	bool stub;    // file node only has what the interface has
+	char *source;
+	size_t size;
+	Hash source_hash;    // of the path and source
+	Hash interface_hash; // of the path and interface, all importers depend on
+	Hash hash;           // object key, source hash and the interface hashes of the imports
+	char *object;     // object file the module is emitted to
+	bool cached;      // object is reused from the cache
+	StdModule *std;   // embedded, never parsed and compiled from its bitcode
+	LLVMModuleRef llvm_module; // the bitcode of std, stripped to what is used
+	ModuleGraph *graph;
+	List imports;   // Module *, in source order
+	List importers; // Module *
+	int pending;    // imports not yet type checked
+	bool checked;
+	int mark;
+} Module;
+
+struct ModuleGraph {
+	Compilation *compilation;
+	pthread_mutex_t lock;
+	Table modules; // path -> Module *
+	List order;    // Module *, every module after its imports, main last
+	Module *main;   // NULL when modules are only imported, like in the repl
+	int checked;    // modules at the start of the order that are checked
+	Table imports; // path -> AstNode * for everything but main, in order
+	Table references; // name -> name of the functions emitted modules declare
+};
+
+Module *module_graph_add(ModuleGraph *graph, char *path);
+void    module_graph_check(ModuleGraph *graph);
+void    module_graph_free(ModuleGraph *graph);
+void    module_graph_init(ModuleGraph *graph, Compilation *compilation);
+void    module_graph_load(ModuleGraph *graph, char *path);
+void    module_graph_parse_stubs(ModuleGraph *graph);
+
+#endif
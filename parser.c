@@ -1,173 +1,181 @@
-#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "parser.h"
+#include "arena.h"
 #include "common.h"
+#include "compilation.h"
 #include "list.h"
+#include "memory.h"
 #include "token.h"
 
-List    *tokens;
-Token   *current_token;
-AstNode *current_node;
+// State of parsing one file, files of a compilation are parsed on several
+// threads at once
+typedef struct {
+	Compilation *compilation;
+	Arena *arena;
+	char *file_path;
+	TokenStream stream;
+	Token token;
+} Parser;
 
-static AstNode *parse_expression();
-static AstNode *parse_statement();
+static AstNode *parse_expression(Parser *parser);
+static AstNode *parse_statement(Parser *parser);
 
-static void print_type_info(TypeInfo *type_info) {
+static void print_type_info(FILE *file, TypeInfo *type_info) {
 	switch (type_info->type) {
 		case TYPE_VALUE: {
 			DEFINE_CSTRING(str, type_info->value_of);
-			printf("%s", str);
+			fprintf(file, "%s", str);
 			break;
 		}
 		case TYPE_ARRAY:
-			printf("[");
-			print_type_info(type_info->array.of);
-			printf("]");
+			fprintf(file, "[");
+			print_type_info(file, type_info->array.of);
+			fprintf(file, "]");
 			break;
 		case TYPE_POINTER:
-			printf("*");
-			print_type_info(type_info->pointer_to);
+			fprintf(file, "*");
+			print_type_info(file, type_info->pointer_to);
 			break;
 	}
 }
 
-static void print_tree(AstNode *node, int level) {
+static void print_tree(FILE *file, AstNode *node, int level) {
     if (node == NULL) {
         return;
     }
     switch (node->type) {
         case AST_ACCESSOR:
-            print_tree(node->as.accessor.left, level);
-            printf("::");
-            print_tree(node->as.accessor.right, level);
+            print_tree(file, node->as.accessor.left, level);
+            fprintf(file, "::");
+            print_tree(file, node->as.accessor.right, level);
             break;
         case AST_ARRAY:
-            printf("[");
+            fprintf(file, "[");
 			List *items = &node->as.array.items;
 			AstNode *item;
 			for (int i = 0; i < items->length; i++) {
 				item = LIST_GET(AstNode *, items, i);
-				print_tree(item, level);
+				print_tree(file, item, level);
 			}
-            printf("]");
+            fprintf(file, "]");
             break;
 	    case AST_ASSIGNMENT: {
 			DEFINE_CSTRING(name, node->as.assignment.name)
-            printf("(%s = ", name);
-            print_tree(node->as.assignment.value, level);
-            printf(")");
+            fprintf(file, "(%s = ", name);
+            print_tree(file, node->as.assignment.value, level);
+            fprintf(file, ")");
             break;
 		}
         case AST_BLOCK:
-            printf("(");
+            fprintf(file, "(");
 			List *statements = &node->as.block.statements;
 			AstNode *statement;
 			for (int i = 0; i < statements->length; i++) {
-				printf("\n%*c", level + 2, ' ');
+				fprintf(file, "\n%*c", level + 2, ' ');
 				statement = LIST_GET(AstNode *, statements, i);
-				print_tree(statement, level + 2);
+				print_tree(file, statement, level + 2);
 			}
-			printf(")");
+			fprintf(file, ")");
             break;
         case AST_BOOL:
-            printf("%b", node->as.bool_);
+            fprintf(file, "%b", node->as.bool_);
             break;
         case AST_FILE:
-            printf("(%s\n", node->as.file.path);
+            fprintf(file, "(%s\n", node->as.file.path);
 			List *nodes = &node->as.file.nodes;
 			for (int i = 0; i < nodes->length; i++) {
-				print_tree(LIST_GET(AstNode *, nodes, i), level);
+				print_tree(file, LIST_GET(AstNode *, nodes, i), level);
 			}
-            printf(")");
+            fprintf(file, ")");
             break;
         case AST_FUNCTION: {
 			DEFINE_CSTRING(name, node->as.fn.name)
-            printf("(fn:%s", name);
+            fprintf(file, "(fn:%s", name);
 			List *parameters = &node->as.fn.parameters;
 			for (int i = 0; i < parameters->length; i++) {
 				AstNode *parameter_node = LIST_GET(AstNode *, parameters, i);
-				printf(" ");
-				print_tree(parameter_node, level);
+				fprintf(file, " ");
+				print_tree(file, parameter_node, level);
 			}
 			if (node->as.fn.statements.elements != NULL) {
 				List *statements = &node->as.fn.statements;
 				for (int i = 0; i < statements->length; i++) {
-					printf("\n%*c", level + 2, ' ');
+					fprintf(file, "\n%*c", level + 2, ' ');
 					AstNode *statement_node = LIST_GET(AstNode *, statements, i);
-					print_tree(statement_node, level + 2);
+					print_tree(file, statement_node, level + 2);
 				}
 			}
-            printf(")");
+            fprintf(file, ")");
             break;
 		}
         case AST_FUNCTION_CALL:
-            printf("(");
-            print_tree(node->as.call.variable, level);
+            fprintf(file, "(");
+            print_tree(file, node->as.call.variable, level);
 			List *arguments = &node->as.call.arguments;
 			for (int i = 0; i < arguments->length; i++) {
-				printf(" ");
-				print_tree(LIST_GET(AstNode *, arguments, i), level);
+				fprintf(file, " ");
+				print_tree(file, LIST_GET(AstNode *, arguments, i), level);
 			}
-            printf(")");
+            fprintf(file, ")");
             break;
         case AST_IF:
-            printf("(if ");
-            print_tree(node->as.if_.condition, level);
-			printf("then ");
-            print_tree(node->as.if_.statement, level);
+            fprintf(file, "(if ");
+            print_tree(file, node->as.if_.condition, level);
+			fprintf(file, "then ");
+            print_tree(file, node->as.if_.statement, level);
 			if (node->as.if_.else_statement != NULL) {
-				printf("else ");
-				print_tree(node->as.if_.else_statement, level);
+				fprintf(file, "else ");
+				print_tree(file, node->as.if_.else_statement, level);
 			}
-            printf(")");
+            fprintf(file, ")");
             break;
 		case AST_ITEM_ACCESS:
-			print_tree(node->as.item_access.indexable, level);
-			printf("[");
-			print_tree(node->as.item_access.index, level);
-			printf("]");
+			print_tree(file, node->as.item_access.indexable, level);
+			fprintf(file, "[");
+			print_tree(file, node->as.item_access.index, level);
+			fprintf(file, "]");
 			break;
 	    case AST_IMPORT: {
 			DEFINE_CSTRING(path, node->as.import.path)
-            printf("(import %s)", path);
+            fprintf(file, "(import %s)", path);
             break;
 		}
         case AST_MATCH: {
-            printf("(match ");
-			print_tree(node->as.match.matcher, level);
+            fprintf(file, "(match ");
+			print_tree(file, node->as.match.matcher, level);
 			List *branches = &node->as.match.branches;
 			for (int i = 0; i < branches->length; i++) {
 				MatchBranch branch = LIST_GET(MatchBranch, &node->as.match.branches, i);
-				printf("\n%*c(", level + 2, ' ');
-				print_type_info(branch.type_info);
-				printf(" ");
-				print_tree(branch.identifier, level);
-				printf(" ");
-				print_tree(branch.expression, level);
-				printf(")");
+				fprintf(file, "\n%*c(", level + 2, ' ');
+				print_type_info(file, branch.type_info);
+				fprintf(file, " ");
+				print_tree(file, branch.identifier, level);
+				fprintf(file, " ");
+				print_tree(file, branch.expression, level);
+				fprintf(file, ")");
 			}
-			printf(")");
+			fprintf(file, ")");
             break;
 		}
         case AST_NUMBER:
-            printf("%f", node->as.number);
+            fprintf(file, "%f", node->as.number);
             break;
         case AST_OPERATOR:
-            printf("(");
-            print_tree(node->as.operator_.left, level);
-            printf(" %s ", token_type_to_string(node->as.operator_.type));
-            print_tree(node->as.operator_.right, level);
-            printf(")");
+            fprintf(file, "(");
+            print_tree(file, node->as.operator_.left, level);
+            fprintf(file, " %s ", token_type_to_string(node->as.operator_.type));
+            print_tree(file, node->as.operator_.right, level);
+            fprintf(file, ")");
             break;
         case AST_PARAMETER:
-			print_type_info(&node->as.parameter.type_info);
+			print_type_info(file, node->as.parameter.type_info);
             break;
 	    case AST_RETURN: {
-            printf("(return ");
-			print_tree(node->as.return_.expression, level);
-            printf(")");
+            fprintf(file, "(return ");
+			print_tree(file, node->as.return_.expression, level);
+            fprintf(file, ")");
             break;
 		}
         case AST_STRING: {
@@ -178,69 +186,86 @@ static void print_tree(AstNode *node, int level) {
 					str[i] = '\\';
 				}
 			}
-            printf("%s", str);
+            fprintf(file, "%s", str);
             break;
         }
         case AST_VARIABLE: {
 			DEFINE_CSTRING(str, node->as.variable.name)
-            printf("%s", str);
+            fprintf(file, "%s", str);
             break;
         }
         case AST_WHILE:
-            printf("(while ");
-            print_tree(node->as.while_.condition, level);
-            printf(" ");
-            print_tree(node->as.while_.statement, level);
-            printf(")");
+            fprintf(file, "(while ");
+            print_tree(file, node->as.while_.condition, level);
+            fprintf(file, " ");
+            print_tree(file, node->as.while_.statement, level);
+            fprintf(file, ")");
             break;
     }
 }
 
-static void consume(TokenType type) {
-    if (current_token->type != type) {
+static inline void advance(Parser *parser) {
+	parser->token = token_next(&parser->stream);
+}
+
+static inline char *token_raw(Parser *parser) {
+	return parser->stream.source + parser->token.offset;
+}
+
+static void report_location(Parser *parser) {
+	int line, col;
+	token_position(&parser->stream, parser->token, &line, &col);
+	fprintf(stderr, "%s:%d:%d: ", parser->file_path, line, col);
+}
+
+static void consume(Parser *parser, TokenType type) {
+    if (parser->token.type != type) {
+        report_location(parser);
         fprintf(stderr, "Epic fail, expected token: %s.\n", token_type_to_string(type));
-        exit(1);
+        fail();
     }
-    current_token++;
+    advance(parser);
 }
 
-static char consume_if(TokenType type) {
-    if (current_token->type != type) {
+static char consume_if(Parser *parser, TokenType type) {
+    if (parser->token.type != type) {
         return 0;
     }
-    current_token++;
+    advance(parser);
 	return 1;
 }
 
-static inline AstNode *create_node(AstType type) {
-    AstNode *node = malloc(sizeof(AstNode));
+static inline AstNode *create_node(Parser *parser, AstType type) {
+    AstNode *node = arena_alloc(parser->arena, sizeof(AstNode));
+	memory_count(MEMORY_AST, sizeof(AstNode));
     node->type = type;
 	node->type_info = NULL;
 	node->backend_ref = NULL;
     return node;
 }
 
-static AstNode *create_number() {
-    float n = strtof(current_token->raw, NULL);
-    AstNode *node = create_node(AST_NUMBER);
+static AstNode *create_number(Parser *parser) {
+    float n = strtof(token_raw(parser), NULL);
+    AstNode *node = create_node(parser, AST_NUMBER);
     node->as.number = n;
     return node;
 }
 
-static AstNode *create_bool() {
-    AstNode *node = create_node(AST_BOOL);
-    node->as.bool_ = current_token->type == TOKEN_TRUE;
+static AstNode *create_bool(Parser *parser) {
+    AstNode *node = create_node(parser, AST_BOOL);
+    node->as.bool_ = parser->token.type == TOKEN_TRUE;
     return node;
 }
 
-static AstNode *create_operator() {
-    AstNode *node = create_node(AST_OPERATOR);
-    node->as.operator_.type = current_token->type;
+static AstNode *create_operator(Parser *parser) {
+    AstNode *node = create_node(parser, AST_OPERATOR);
+    node->as.operator_.type = parser->token.type;
     return node;
 }
 
-static String escape_string(String original) {
-	char *str = malloc(original.length + 1);
+static String escape_string(Parser *parser, String original) {
+	char *str = arena_alloc(parser->arena, original.length + 1);
+	memory_count(MEMORY_STRINGS, original.length + 1);
 	char last = '\0';
 	int pos = 0;
 
@@ -257,129 +282,128 @@ static String escape_string(String original) {
 	return res;
 }
 
-static AstNode *create_string() {
-    AstNode *node = create_node(AST_STRING);
-    node->as.string.p = current_token->raw + 1;
-    node->as.string.length = current_token->length - 2;
-	node->as.string = escape_string(node->as.string);
+static AstNode *create_string(Parser *parser) {
+    AstNode *node = create_node(parser, AST_STRING);
+    node->as.string.p = token_raw(parser) + 1;
+    node->as.string.length = parser->token.length - 2;
+	node->as.string = escape_string(parser, node->as.string);
     return node;
 }
 
-static AstNode *create_variable() {
-    AstNode *node = create_node(AST_VARIABLE);
-    node->as.variable.name.p = current_token->raw;
-    node->as.variable.name.length = current_token->length;
+static AstNode *create_variable(Parser *parser) {
+    AstNode *node = create_node(parser, AST_VARIABLE);
+    node->as.variable.name.p = token_raw(parser);
+    node->as.variable.name.length = parser->token.length;
+    node->as.variable.symbol = symbol_intern(&parser->compilation->symbols, node->as.variable.name);
     node->as.variable.declaration = NULL;
     return node;
 }
 
-static TypeInfo *parse_type() {
-	TypeInfo *type_info = malloc(sizeof(TypeInfo));
-	if (current_token->type == TOKEN_STAR) {
-		current_token++;
-		type_info->type = TYPE_POINTER;
-		type_info->pointer_to = parse_type();
-	} else if (current_token->type == TOKEN_IDENTIFIER) {
-		String type_name = { current_token->raw, current_token->length };
-		current_token++;
-		type_info->type = TYPE_VALUE;
-		type_info->value_of = type_name;
-		if (current_token->type == TOKEN_LEFT_BRACKET) {
-			current_token++;
+static TypeInfo *parse_type(Parser *parser) {
+	TypeInfo *type_info;
+	if (parser->token.type == TOKEN_STAR) {
+		advance(parser);
+		type_info = type_pointer(&parser->compilation->types, parse_type(parser));
+	} else if (parser->token.type == TOKEN_IDENTIFIER) {
+		String type_name = { token_raw(parser), parser->token.length };
+		advance(parser);
+		type_info = type_value(&parser->compilation->types, type_name);
+		if (parser->token.type == TOKEN_LEFT_BRACKET) {
+			advance(parser);
 			// TODO: improve validation
-			if (current_token->type != TOKEN_NUMBER) {
+			if (parser->token.type != TOKEN_NUMBER) {
+				report_location(parser);
 				fprintf(stderr, "Epic fail, expected number in array type but got: %s.\n",
-						token_type_to_string(current_token->type));
+						token_type_to_string(parser->token.type));
 			}
-			int n = strtol(current_token->raw, NULL, 10);
-			current_token++;
-
-			TypeInfo *array_type_info = malloc(sizeof(TypeInfo));
-			array_type_info->type = TYPE_ARRAY;
-			array_type_info->array.length = n;
-			array_type_info->array.of = type_info;
-			type_info = array_type_info;
-			consume(TOKEN_RIGHT_BRACKET);
+			int n = strtol(token_raw(parser), NULL, 10);
+			advance(parser);
+
+			type_info = type_array(&parser->compilation->types, type_info, n);
+			consume(parser, TOKEN_RIGHT_BRACKET);
 		}
 	} else {
+		report_location(parser);
 		fprintf(stderr, "Epic fail, expected star or identifier but got: %s.\n",
-				token_type_to_string(current_token->type));
-		exit(1);
+				token_type_to_string(parser->token.type));
+		fail();
 	}
 	return type_info;
 }
 
-static AstNode *parse_primary() {
-    if (current_token->type == TOKEN_TRUE || current_token->type == TOKEN_FALSE) {
-        AstNode *bool_ = create_bool();
-        current_token++;
+static AstNode *parse_primary(Parser *parser) {
+    if (parser->token.type == TOKEN_TRUE || parser->token.type == TOKEN_FALSE) {
+        AstNode *bool_ = create_bool(parser);
+        advance(parser);
         return bool_;
-	} else if (current_token->type == TOKEN_NUMBER) {
-        AstNode *number = create_number();
-        current_token++;
+	} else if (parser->token.type == TOKEN_NUMBER) {
+        AstNode *number = create_number(parser);
+        advance(parser);
         return number;
-    } else if (current_token->type == TOKEN_STRING) {
-        AstNode *string = create_string();
-        current_token++;
+    } else if (parser->token.type == TOKEN_STRING) {
+        AstNode *string = create_string(parser);
+        advance(parser);
         return string;
-    } else if (current_token->type == TOKEN_IDENTIFIER) {
-        AstNode *variable = create_variable();
-        current_token++;
+    } else if (parser->token.type == TOKEN_IDENTIFIER) {
+        AstNode *variable = create_variable(parser);
+        advance(parser);
         return variable;
     } else {
-        const char *name = token_type_to_string(current_token->type);
+        const char *name = token_type_to_string(parser->token.type);
+        report_location(parser);
         fprintf(stderr, "Epic fail, we can't handle '%s' as a primary.\n", name);
-        exit(1);
+        fail();
     }
 }
 
-static AstNode *parse_accessor() {
-	AstNode *primary = parse_primary();
-	if (primary->type == AST_VARIABLE && current_token->type == TOKEN_DOUBLE_COLON) {
-		current_token++;
-		if (current_token->type != TOKEN_IDENTIFIER) {
+static AstNode *parse_accessor(Parser *parser) {
+	AstNode *primary = parse_primary(parser);
+	if (primary->type == AST_VARIABLE && parser->token.type == TOKEN_DOUBLE_COLON) {
+		advance(parser);
+		if (parser->token.type != TOKEN_IDENTIFIER) {
+			report_location(parser);
 			fprintf(stderr, "Epic fail, expected identifier but got: %s.\n",
-					token_type_to_string(current_token->type));
-			exit(1);
+					token_type_to_string(parser->token.type));
+			fail();
 		}
-		AstNode *accessor_node = create_node(AST_ACCESSOR);
+		AstNode *accessor_node = create_node(parser, AST_ACCESSOR);
 		accessor_node->as.accessor.left = primary;
-		accessor_node->as.accessor.right = create_variable();
-		current_token++;
+		accessor_node->as.accessor.right = create_variable(parser);
+		advance(parser);
 		primary = accessor_node;
 	}
 	return primary;
 }
 
-static AstNode *parse_call() {
-    AstNode *accessor = parse_accessor();
-	if ((accessor->type == AST_VARIABLE || accessor->type == AST_ACCESSOR) && current_token->type == TOKEN_LEFT_PAREN) {
-		current_token++;
-		AstNode *call = create_node(AST_FUNCTION_CALL);
+static AstNode *parse_call(Parser *parser) {
+    AstNode *accessor = parse_accessor(parser);
+	if ((accessor->type == AST_VARIABLE || accessor->type == AST_ACCESSOR) && parser->token.type == TOKEN_LEFT_PAREN) {
+		advance(parser);
+		AstNode *call = create_node(parser, AST_FUNCTION_CALL);
 		call->as.call.variable = accessor;
 		accessor = call;
 		list_init(&call->as.call.arguments, sizeof(AstNode *));
-		if (current_token->type != TOKEN_RIGHT_PAREN) {
-			AstNode *argument = parse_expression();
+		if (parser->token.type != TOKEN_RIGHT_PAREN) {
+			AstNode *argument = parse_expression(parser);
 			list_add(&call->as.call.arguments, &argument);
-			while (current_token->type == TOKEN_COMMA) {
-				current_token++;
-				argument = parse_expression();
+			while (parser->token.type == TOKEN_COMMA) {
+				advance(parser);
+				argument = parse_expression(parser);
 				list_add(&call->as.call.arguments, &argument);
 			}
 		}
-		consume(TOKEN_RIGHT_PAREN);
+		consume(parser, TOKEN_RIGHT_PAREN);
 	}
     return accessor;
 }
 
-static AstNode *parse_item_access() {
-    AstNode *call = parse_call();
-	while (current_token->type == TOKEN_LEFT_BRACKET) {
-		current_token++;
-		AstNode *index = parse_expression();
-		consume(TOKEN_RIGHT_BRACKET);
-		AstNode *access = create_node(AST_ITEM_ACCESS);
+static AstNode *parse_item_access(Parser *parser) {
+    AstNode *call = parse_call(parser);
+	while (parser->token.type == TOKEN_LEFT_BRACKET) {
+		advance(parser);
+		AstNode *index = parse_expression(parser);
+		consume(parser, TOKEN_RIGHT_BRACKET);
+		AstNode *access = create_node(parser, AST_ITEM_ACCESS);
 		access->as.item_access.index = index;
 		access->as.item_access.indexable = call;
 		call = access;
@@ -387,176 +411,186 @@ static AstNode *parse_item_access() {
 	return call;
 }
 
-static AstNode *parse_factor() {
-    AstNode *call = parse_item_access();
-    while (current_token->type == TOKEN_STAR || current_token->type == TOKEN_SLASH) {
-        AstNode *operator = create_operator();
-        current_token++;
+static AstNode *parse_factor(Parser *parser) {
+    AstNode *call = parse_item_access(parser);
+    while (parser->token.type == TOKEN_STAR || parser->token.type == TOKEN_SLASH) {
+        AstNode *operator = create_operator(parser);
+        advance(parser);
         operator->as.operator_.left = call;
-        operator->as.operator_.right = parse_item_access();
+        operator->as.operator_.right = parse_item_access(parser);
         call = operator;
     }
     return call;
 }
 
-static AstNode *parse_term() {
-    AstNode *factor = parse_factor();
-    while (current_token->type == TOKEN_PLUS || current_token->type == TOKEN_MINUS) {
-        AstNode *operator = create_operator();
-        current_token++;
+static AstNode *parse_term(Parser *parser) {
+    AstNode *factor = parse_factor(parser);
+    while (parser->token.type == TOKEN_PLUS || parser->token.type == TOKEN_MINUS) {
+        AstNode *operator = create_operator(parser);
+        advance(parser);
         operator->as.operator_.left = factor;
-        operator->as.operator_.right = parse_factor();
+        operator->as.operator_.right = parse_factor(parser);
         factor = operator;
     }
     return factor;
 }
 
-static AstNode *parse_comparison() {
-    AstNode *term = parse_term();
-    if (current_token->type == TOKEN_DOUBLE_EQUAL ||
-		current_token->type == TOKEN_GREATER_THAN || 
-		current_token->type == TOKEN_GREATER_THAN_OR_EQUAL ||
-		current_token->type == TOKEN_LESS_THAN ||
-		current_token->type == TOKEN_LESS_THAN_OR_EQUAL ||
-		current_token->type == TOKEN_NOT_EQUAL) {
-        AstNode *operator = create_operator();
-        current_token++;
+static AstNode *parse_comparison(Parser *parser) {
+    AstNode *term = parse_term(parser);
+    if (parser->token.type == TOKEN_DOUBLE_EQUAL ||
+		parser->token.type == TOKEN_GREATER_THAN || 
+		parser->token.type == TOKEN_GREATER_THAN_OR_EQUAL ||
+		parser->token.type == TOKEN_LESS_THAN ||
+		parser->token.type == TOKEN_LESS_THAN_OR_EQUAL ||
+		parser->token.type == TOKEN_NOT_EQUAL) {
+        AstNode *operator = create_operator(parser);
+        advance(parser);
         operator->as.operator_.left = term;
-        operator->as.operator_.right = parse_term();
+        operator->as.operator_.right = parse_term(parser);
 		term = operator;
 	}
     return term;
 }
 
-static AstNode *parse_logical_and() {
-    AstNode *comparison = parse_comparison();
-    while (current_token->type == TOKEN_LOGICAL_AND) {
-        AstNode *operator = create_operator();
-        current_token++;
+static AstNode *parse_logical_and(Parser *parser) {
+    AstNode *comparison = parse_comparison(parser);
+    while (parser->token.type == TOKEN_LOGICAL_AND) {
+        AstNode *operator = create_operator(parser);
+        advance(parser);
         operator->as.operator_.left = comparison;
-        operator->as.operator_.right = parse_comparison();
+        operator->as.operator_.right = parse_comparison(parser);
 		comparison = operator;
 	}
     return comparison;
 }
 
-static AstNode *parse_logical_or() {
-    AstNode *logical_and = parse_logical_and();
-    while (current_token->type == TOKEN_LOGICAL_OR) {
-        AstNode *operator = create_operator();
-        current_token++;
+static AstNode *parse_logical_or(Parser *parser) {
+    AstNode *logical_and = parse_logical_and(parser);
+    while (parser->token.type == TOKEN_LOGICAL_OR) {
+        AstNode *operator = create_operator(parser);
+        advance(parser);
         operator->as.operator_.left = logical_and;
-        operator->as.operator_.right = parse_logical_and();
+        operator->as.operator_.right = parse_logical_and(parser);
 		logical_and = operator;
 	}
     return logical_and;
 }
 
-static AstNode *parse_array() {
-    if (current_token->type == TOKEN_LEFT_BRACKET) {
-		current_token++;
-		AstNode *node = create_node(AST_ARRAY);
+static AstNode *parse_array(Parser *parser) {
+    if (parser->token.type == TOKEN_LEFT_BRACKET) {
+		advance(parser);
+		AstNode *node = create_node(parser, AST_ARRAY);
 		list_init(&node->as.array.items, sizeof(AstNode *));
-		while (current_token->type != TOKEN_RIGHT_BRACKET && (current_token - (Token *)tokens->elements) < tokens->length) {
-			AstNode *expr = parse_logical_or();
+		while (parser->token.type != TOKEN_RIGHT_BRACKET && parser->token.type != TOKEN_EOF) {
+			AstNode *expr = parse_logical_or(parser);
 			list_add(&node->as.array.items, &expr);
-			if (!consume_if(TOKEN_COMMA)) {
+			if (!consume_if(parser, TOKEN_COMMA)) {
 				break;
 			}
 		}
-		consume(TOKEN_RIGHT_BRACKET);
+		consume(parser, TOKEN_RIGHT_BRACKET);
 		return node;
 	}
 
-	return parse_logical_or();
+	return parse_logical_or(parser);
 }
 
-static AstNode *parse_match() {
-    if (current_token->type == TOKEN_MATCH) {
-		current_token++;
-		AstNode *node = create_node(AST_MATCH);
-		node->as.match.matcher = parse_array();
-		consume(TOKEN_LEFT_BRACE);
+static AstNode *parse_match(Parser *parser) {
+    if (parser->token.type == TOKEN_MATCH) {
+		advance(parser);
+		AstNode *node = create_node(parser, AST_MATCH);
+		node->as.match.matcher = parse_array(parser);
+		consume(parser, TOKEN_LEFT_BRACE);
 
 		list_init(&node->as.match.branches, sizeof(MatchBranch));
 
-		while (current_token->type != TOKEN_RIGHT_BRACE) {
+		while (parser->token.type != TOKEN_RIGHT_BRACE) {
 			MatchBranch branch;
-			branch.type_info = parse_type();
+			branch.type_info = parse_type(parser);
 
-			assert(current_token->type == TOKEN_IDENTIFIER);
-			branch.identifier = create_variable();
-			current_token++;
+			if (parser->token.type != TOKEN_IDENTIFIER) {
+				report_location(parser);
+				fprintf(stderr, "Epic fail, expected identifier but got: %s.\n",
+						token_type_to_string(parser->token.type));
+				fail();
+			}
+			branch.identifier = create_variable(parser);
+			advance(parser);
 
-			consume(TOKEN_ARROW);
+			consume(parser, TOKEN_ARROW);
 
-			branch.expression = parse_expression();
+			branch.expression = parse_expression(parser);
 
 			list_add(&node->as.match.branches, &branch);
 		}
 
-		consume(TOKEN_RIGHT_BRACE);
+		consume(parser, TOKEN_RIGHT_BRACE);
 		return node;
 	}
 
-	return parse_array();
+	return parse_array(parser);
 }
 
-static AstNode *parse_expression() {
-	return parse_match();
+static AstNode *parse_expression(Parser *parser) {
+	return parse_match(parser);
 }
 
-static AstNode *parse_assignment_or_expression_statement() {
-    AstNode *dst = parse_expression();
+static AstNode *parse_assignment_or_expression_statement(Parser *parser) {
+    AstNode *dst = parse_expression(parser);
 
 	TypeInfo *type_info = NULL;
-	if (current_token->type == TOKEN_COLON) {
-		assert(dst->type == AST_VARIABLE);
-		current_token++;
-		type_info = parse_type();
+	bool typed = parser->token.type == TOKEN_COLON;
+	if ((typed || parser->token.type == TOKEN_EQUAL) && dst->type != AST_VARIABLE) {
+		report_location(parser);
+		fprintf(stderr, "Epic fail, only variables can be assigned.\n");
+		fail();
+	}
+	if (typed) {
+		advance(parser);
+		type_info = parse_type(parser);
 	}
 
-	bool explicit_assignment = current_token->type == TOKEN_EQUAL;
+	bool explicit_assignment = parser->token.type == TOKEN_EQUAL;
 	if (explicit_assignment || type_info != NULL) {
-        assert(dst->type == AST_VARIABLE);
-        AstNode *ass = create_node(AST_ASSIGNMENT);
+        AstNode *ass = create_node(parser, AST_ASSIGNMENT);
         ass->as.assignment.name = dst->as.variable.name;
+        ass->as.assignment.symbol = dst->as.variable.symbol;
 		if (explicit_assignment) {
-			current_token++;
-			ass->as.assignment.value = parse_expression();
+			advance(parser);
+			ass->as.assignment.value = parse_expression(parser);
 		} else {
 			ass->as.assignment.value = NULL;
 		}
         ass->as.assignment.initial = NULL;
         ass->as.assignment.type_info = type_info;
-		free(dst);
+        ass->as.assignment.global = NULL;
         dst = ass;
     }
 
-	consume(TOKEN_SEMICOLON);
+	consume(parser, TOKEN_SEMICOLON);
 
     return dst;
 }
 
-static AstNode *parse_return_statement() {
-	AstNode *return_node = create_node(AST_RETURN);
-	current_token++;
-	return_node->as.return_.expression = parse_expression();
-    consume(TOKEN_SEMICOLON);
+static AstNode *parse_return_statement(Parser *parser) {
+	AstNode *return_node = create_node(parser, AST_RETURN);
+	advance(parser);
+	return_node->as.return_.expression = parse_expression(parser);
+    consume(parser, TOKEN_SEMICOLON);
 	return return_node;
 }
 
-static AstNode *parse_block();
+static AstNode *parse_block(Parser *parser);
 
-static AstNode *parse_if_statement() {
-	AstNode *if_node = create_node(AST_IF);
-	current_token++;
+static AstNode *parse_if_statement(Parser *parser) {
+	AstNode *if_node = create_node(parser, AST_IF);
+	advance(parser);
 
-	if_node->as.if_.condition = parse_expression();
-	if_node->as.if_.statement = parse_block();
-	if (current_token->type == TOKEN_ELSE) {
-		current_token++;
-		if_node->as.if_.else_statement = parse_statement();
+	if_node->as.if_.condition = parse_expression(parser);
+	if_node->as.if_.statement = parse_block(parser);
+	if (parser->token.type == TOKEN_ELSE) {
+		advance(parser);
+		if_node->as.if_.else_statement = parse_statement(parser);
 	} else {
 		if_node->as.if_.else_statement = NULL;
 	}
@@ -564,192 +598,210 @@ static AstNode *parse_if_statement() {
 	return if_node;
 }
 
-static AstNode *parse_while_statement() {
-	AstNode *while_node = create_node(AST_WHILE);
-	current_token++;
-	while_node->as.while_.condition = parse_expression();
-	while_node->as.while_.statement = parse_block();
+static AstNode *parse_while_statement(Parser *parser) {
+	AstNode *while_node = create_node(parser, AST_WHILE);
+	advance(parser);
+	while_node->as.while_.condition = parse_expression(parser);
+	while_node->as.while_.statement = parse_block(parser);
 	return while_node;
 }
 
-static AstNode *parse_statement() {
-	switch (current_token->type) {
+static AstNode *parse_statement(Parser *parser) {
+	switch (parser->token.type) {
 	case TOKEN_WHILE:
-		return parse_while_statement();
+		return parse_while_statement(parser);
 	case TOKEN_IF:
-		return parse_if_statement();
+		return parse_if_statement(parser);
 	case TOKEN_RETURN:
-		return parse_return_statement();
+		return parse_return_statement(parser);
 	case TOKEN_LEFT_BRACE:
-		return parse_block();
+		return parse_block(parser);
 	default:
-		return parse_assignment_or_expression_statement();
+		return parse_assignment_or_expression_statement(parser);
 	}
 }
 
-static AstNode *parse_block() {
-	consume(TOKEN_LEFT_BRACE);
-	AstNode *block_node = create_node(AST_BLOCK);
+static AstNode *parse_block(Parser *parser) {
+	consume(parser, TOKEN_LEFT_BRACE);
+	AstNode *block_node = create_node(parser, AST_BLOCK);
 	block_node->as.block.scope = NULL;
 	
 	list_init(&block_node->as.block.statements, sizeof(AstNode *));
-	while (current_token->type != TOKEN_RIGHT_BRACE && (current_token - (Token *)tokens->elements) < tokens->length) {
-		AstNode *statement = parse_statement();
+	while (parser->token.type != TOKEN_RIGHT_BRACE && parser->token.type != TOKEN_EOF) {
+		AstNode *statement = parse_statement(parser);
 		list_add(&block_node->as.block.statements, &statement);
 	}
 
-	consume(TOKEN_RIGHT_BRACE);
+	consume(parser, TOKEN_RIGHT_BRACE);
 	return block_node;
 }
 
-static AstNode *parse_function(bool external) {
-	AstNode *fn_node = create_node(AST_FUNCTION);
+static AstNode *parse_function(Parser *parser, bool external) {
+	AstNode *fn_node = create_node(parser, AST_FUNCTION);
 	fn_node->as.fn.scope = NULL;
-	current_token++;
-	if (current_token->type != TOKEN_IDENTIFIER) {
+	advance(parser);
+	if (parser->token.type != TOKEN_IDENTIFIER) {
+		report_location(parser);
 		fprintf(stderr, "Epic fail, expected identifier but got: %s.\n",
-				token_type_to_string(current_token->type));
-		exit(1);
+				token_type_to_string(parser->token.type));
+		fail();
 	}
 
 	fn_node->as.fn.external = external;
 	fn_node->as.fn.vararg = false;
-    fn_node->as.fn.name.p = current_token->raw;
-    fn_node->as.fn.name.length = current_token->length;
-	current_token++;
+	fn_node->as.fn.globals = false;
+    fn_node->as.fn.name.p = token_raw(parser);
+    fn_node->as.fn.name.length = parser->token.length;
+	fn_node->as.fn.symbol = NULL;
+	advance(parser);
 
-	consume(TOKEN_LEFT_PAREN);
+	consume(parser, TOKEN_LEFT_PAREN);
 
 	// Parameters
-	if (current_token->type != TOKEN_RIGHT_PAREN) {
+	if (parser->token.type != TOKEN_RIGHT_PAREN) {
 		list_init(&fn_node->as.fn.parameters, sizeof(AstNode *));
 			
 		Parameter parameter;
 		do {
-			parameter.rest = consume_if(TOKEN_TRIPLE_DOT);
-			if (current_token->type != TOKEN_IDENTIFIER && !parameter.rest) {
+			parameter.rest = consume_if(parser, TOKEN_TRIPLE_DOT);
+			if (parser->token.type != TOKEN_IDENTIFIER && !parameter.rest) {
+				report_location(parser);
 				fprintf(stderr, "Epic fail, expected identifier (type) but got: %s.\n",
-						token_type_to_string(current_token->type));
-				exit(1);
-			} else if (current_token->type != TOKEN_IDENTIFIER) {
+						token_type_to_string(parser->token.type));
+				fail();
+			} else if (parser->token.type != TOKEN_IDENTIFIER) {
 				fn_node->as.fn.vararg = true;
 				break;
 			}
-			parameter.name.p = current_token->raw;
-			parameter.name.length = current_token->length;
-			current_token++;
-			consume(TOKEN_COLON);
+			parameter.name.p = token_raw(parser);
+			parameter.name.length = parser->token.length;
+			parameter.symbol = symbol_intern(&parser->compilation->symbols, parameter.name);
+			advance(parser);
+			consume(parser, TOKEN_COLON);
 
-			TypeInfo *type_info = parse_type();
+			parameter.type_info = parse_type(parser);
 			if (parameter.rest) {
-				parameter.type_info.type = TYPE_POINTER;
-				parameter.type_info.pointer_to = type_info;
-			} else {
-				parameter.type_info = *type_info;
-				free(type_info);
+				parameter.type_info = type_pointer(&parser->compilation->types, parameter.type_info);
 			}
 			
-			AstNode *parameter_node = create_node(AST_PARAMETER);
+			AstNode *parameter_node = create_node(parser, AST_PARAMETER);
 			parameter_node->as.parameter = parameter;
 			list_add(&fn_node->as.fn.parameters, &parameter_node);
-		} while (!parameter.rest && consume_if(TOKEN_COMMA));
+		} while (!parameter.rest && consume_if(parser, TOKEN_COMMA));
     } else {
 		fn_node->as.fn.parameters.length = 0;
     }
 
-	consume(TOKEN_RIGHT_PAREN);
+	consume(parser, TOKEN_RIGHT_PAREN);
 
 	// Type
-	if (current_token->type == TOKEN_COLON) {
-		current_token++;
-		bool pointer = consume_if(TOKEN_STAR);
-		if (current_token->type != TOKEN_IDENTIFIER) {
+	if (parser->token.type == TOKEN_COLON) {
+		advance(parser);
+		bool pointer = consume_if(parser, TOKEN_STAR);
+		if (parser->token.type != TOKEN_IDENTIFIER) {
+			report_location(parser);
 			fprintf(stderr, "Epic fail, expected identifier (type) but got: %s.\n",
-					token_type_to_string(current_token->type));
-			exit(1);
+					token_type_to_string(parser->token.type));
+			fail();
 		}
 
-		Type *type = malloc(sizeof(Type));
-		type->name.p = current_token->raw;
-		type->name.length = current_token->length;
+		Type *type = arena_alloc(parser->arena, sizeof(Type));
+		memory_count(MEMORY_AST, sizeof(Type));
+		type->name.p = token_raw(parser);
+		type->name.length = parser->token.length;
 		type->pointer = pointer;
 		fn_node->as.fn.type = type;
-		current_token++;
+		advance(parser);
 	} else {
 		fn_node->as.fn.type = NULL;
 	}
 
 	if (!external) {
-		consume(TOKEN_LEFT_BRACE);
+		consume(parser, TOKEN_LEFT_BRACE);
 		list_init(&fn_node->as.fn.statements, sizeof(AstNode *));
-		while (current_token->type != TOKEN_RIGHT_BRACE && (current_token - (Token *)tokens->elements) < tokens->length) {
-			AstNode *statement = parse_statement();
+		while (parser->token.type != TOKEN_RIGHT_BRACE && parser->token.type != TOKEN_EOF) {
+			AstNode *statement = parse_statement(parser);
 			list_add(&fn_node->as.fn.statements, &statement);
 		}
-		consume(TOKEN_RIGHT_BRACE);
+		consume(parser, TOKEN_RIGHT_BRACE);
 	} else {
 		fn_node->as.fn.statements.elements = NULL;
 		fn_node->as.fn.statements.length = 0;
-		consume(TOKEN_SEMICOLON);
+		consume(parser, TOKEN_SEMICOLON);
 	}
 
 	return fn_node;
 }
 
-static AstNode *parse_import() {
-	AstNode *import_node = create_node(AST_IMPORT);
-	current_token++;
+static AstNode *parse_import(Parser *parser) {
+	AstNode *import_node = create_node(parser, AST_IMPORT);
+	advance(parser);
 	
-	if (current_token->type != TOKEN_STRING) {
+	if (parser->token.type != TOKEN_STRING) {
+		report_location(parser);
 		fprintf(stderr, "Epic fail, expected import path but got: %s.\n",
-				token_type_to_string(current_token->type));
-		exit(1);
+				token_type_to_string(parser->token.type));
+		fail();
 	}
 	
-    import_node->as.import.path.p = current_token->raw + 1;
-    import_node->as.import.path.length = current_token->length - 2;
+    import_node->as.import.path.p = token_raw(parser) + 1;
+    import_node->as.import.path.length = parser->token.length - 2;
     import_node->as.import.file_node = NULL;
-	current_token++;
+	advance(parser);
 
 	return import_node;
 }
 
-static AstNode *parse_declaration() {
-	switch (current_token->type) {
+static AstNode *parse_declaration(Parser *parser) {
+	switch (parser->token.type) {
 	case TOKEN_EXTERN:
-		current_token++;
-		return parse_function(true);
+		advance(parser);
+		return parse_function(parser, true);
 	case TOKEN_FUN:
-		return parse_function(false);
+		return parse_function(parser, false);
 	case TOKEN_IMPORT:
-		return parse_import();
+		return parse_import(parser);
 	default:
-		return parse_statement();
+		return parse_statement(parser);
 	}
 }
 
-void parse(List *t, List *nodes) {
-    tokens = t;
-    current_token = tokens->elements;
+void parse(Compilation *compilation, Arena *arena, char *path, char *source, List *nodes) {
+	Parser parser;
+	parser.compilation = compilation;
+	parser.arena = arena;
+	parser.file_path = path;
+	token_stream_init(&parser.stream, source);
+	advance(&parser);
 
     AstNode *expression;
-    while (current_token->type != TOKEN_EOF && (current_token - (Token *)tokens->elements) < tokens->length) {
-        expression = parse_declaration();
-#ifdef DEBUG
-        print_tree(expression, 0);
-    	putchar('\n');
-#endif
+    while (parser.token.type != TOKEN_EOF) {
+        expression = parse_declaration(&parser);
     	list_add(nodes, &expression);
 	}
+	free(parser.stream.newlines.elements);
+}
+
+void print_ast(FILE *file, AstNode *file_node) {
+	List *nodes = &file_node->as.file.nodes;
+	for (int i = 0; i < nodes->length; i++) {
+		print_tree(file, LIST_GET(AstNode *, nodes, i), 0);
+		fputc('\n', file);
+	}
 }
 
-AstNode *parse_file(char *path, List *t) {
-	AstNode *file_node = create_node(AST_FILE);
+AstNode *parse_file(Compilation *compilation, Arena *arena, char *path, char *source) {
+	AstNode *file_node = arena_alloc(arena, sizeof(AstNode));
+	memory_count(MEMORY_AST, sizeof(AstNode));
+	file_node->type = AST_FILE;
+	file_node->type_info = NULL;
+	file_node->backend_ref = NULL;
 	file_node->as.file.scope = NULL;
 	file_node->as.file.path = path;
-	file_node->as.file.tokens = *t;
+	file_node->as.file.module = symbol_intern(&compilation->symbols, STRING(path));
+	file_node->as.file.source = source;
 	list_init(&file_node->as.file.nodes, sizeof(AstNode *));
 
-	parse(&file_node->as.file.tokens, &file_node->as.file.nodes);
+	parse(compilation, arena, path, source, &file_node->as.file.nodes);
 	return file_node;
 }
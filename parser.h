@@ -2,10 +2,14 @@
 #define PENQUIN_PARSER_H
 
 #include <stdbool.h>
+#include "arena.h"
 #include "common.h"
 #include "list.h"
+#include "penquin.h"
 #include "token.h"
+#include "symbol.h"
 #include "table.h"
+#include "type.h"
 
 typedef struct Scope {
 	struct Scope *prev;
@@ -13,33 +17,17 @@ typedef struct Scope {
 	Table *definitions;
 } Scope;
 
-typedef enum {
-	TYPE_VALUE,
-	TYPE_ARRAY,
-	TYPE_POINTER,
-} TypeType;
-
-typedef struct TypeInfo {
-	TypeType type;
-	union {
-		struct {
-			struct TypeInfo *of;
-			int length;
-		} array;
-		struct TypeInfo *pointer_to;
-		String value_of;
-	};
-} TypeInfo;
-
 typedef struct {
 	List items;
 } Array;
 
 typedef struct {
 	String name;
+	Symbol *symbol;
 	struct AstNode *value;
 	struct AstNode *initial;
 	TypeInfo *type_info;
+	Symbol *global; // qualified name when declared as a global, NULL for locals
 } Assignment;
 
 typedef struct {
@@ -54,18 +42,21 @@ typedef struct {
 
 typedef struct {
 	char *path;
-	List tokens;
+	Symbol *module;
+	char *source;
 	List nodes;
 	Scope *scope;
 } File;
 
 typedef struct {
 	String name;
+	Symbol *symbol;
 	List parameters;
 	List statements;
 	struct Type *type;
 	bool external;
 	bool vararg;
+	bool globals; // variables first assigned at its top level are globals, like in repl statements
 	Scope *scope;
 } Function;
 
@@ -110,8 +101,9 @@ typedef struct {
 
 typedef struct {
 	bool rest;
-	TypeInfo type_info;
+	TypeInfo *type_info;
 	String name;
+	Symbol *symbol;
 } Parameter;
 
 typedef struct {
@@ -125,6 +117,7 @@ typedef struct Type {
 
 typedef struct {
 	String name;
+	Symbol *symbol;
 	struct AstNode *declaration;
 } Variable;
 
@@ -184,7 +177,8 @@ typedef struct AstNode {
 } AstNode;
 
 
-void     parse(List *t, List *nodes);
-AstNode *parse_file(char *path, List *t);
+void     parse(Compilation *compilation, Arena *arena, char *path, char *source, List *nodes);
+AstNode *parse_file(Compilation *compilation, Arena *arena, char *path, char *source);
+void     print_ast(FILE *file, AstNode *file_node);
 
 #endif
@@ -0,0 +1,511 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+#include <llvm-c/Support.h>
+#include <llvm-c/Transforms/PassBuilder.h>
+#include <llvm-c/TargetMachine.h>
+#include "penquin.h"
+#include "arena.h"
+#include "cache.h"
+#include "codegen.h"
+#include "common.h"
+#include "compilation.h"
+#include "interface.h"
+#include "jit.h"
+#include "module.h"
+#include "pool.h"
+#include "resolver.h"
+#include "symbol.h"
+#include "type.h"
+
+// Native is the host's CPU with the features it has, features given in the
+// options come after so they can turn some off again
+static void resolve_target(Compilation *compilation) {
+	char *cpu = compilation->options.cpu != NULL ? compilation->options.cpu : "";
+	char *features = compilation->options.features != NULL ? compilation->options.features : "";
+	if (strcmp(cpu, "native") == 0) {
+		char *host_cpu = LLVMGetHostCPUName();
+		char *host_features = LLVMGetHostCPUFeatures();
+		compilation->cpu = cstring_duplicate(host_cpu);
+		compilation->features = malloc(strlen(host_features) + strlen(features) + 2);
+		sprintf(compilation->features, "%s%s%s", host_features, features[0] != '\0' ? "," : "", features);
+		LLVMDisposeMessage(host_cpu);
+		LLVMDisposeMessage(host_features);
+	} else {
+		compilation->cpu = cstring_duplicate(cpu);
+		compilation->features = cstring_duplicate(features);
+	}
+}
+
+// LLVM times its own passes and prints them when the pass manager is done,
+// its options are global to the process so this is only done once
+static void enable_time_passes() {
+	const char *arguments[] = { "penquin", "-time-passes" };
+	LLVMParseCommandLineOptions(2, arguments, NULL);
+}
+
+Compilation *penquin_create(PenquinOptions *options) {
+	Compilation *compilation = malloc(sizeof(Compilation));
+	compilation->options = *options;
+	if (compilation->options.jobs < 1) {
+		compilation->options.jobs = pool_default_workers();
+	}
+	if (compilation->options.opt_level == '\0') {
+		compilation->options.opt_level = '0';
+	}
+	bool huge_pages = compilation->options.huge_pages;
+	int jobs = compilation->options.jobs;
+	timings_init(&compilation->timings, compilation->options.time_report || compilation->options.trace != NULL);
+	memory_init(&compilation->memory, compilation->options.mem_report);
+	memory_enter(&compilation->memory, MEMORY_SETUP);
+	if (compilation->options.time_report) {
+		static pthread_once_t time_passes = PTHREAD_ONCE_INIT;
+		pthread_once(&time_passes, enable_time_passes);
+	}
+
+	// Interned symbols and types live until codegen is done
+	symbol_initialize(&compilation->symbols, huge_pages);
+	type_initialize(&compilation->types, huge_pages);
+
+	// Scopes live in the main arena, AST nodes in the arena of the worker
+	// that parsed them
+	arena_init(&compilation->arena, huge_pages);
+	compilation->arenas = malloc(sizeof(Arena) * jobs);
+	for (int i = 0; i < jobs; i++) {
+		arena_init(&compilation->arenas[i], huge_pages);
+	}
+
+	pool_init(&compilation->pool, jobs);
+	module_graph_init(&compilation->graph, compilation);
+	resolver_initialize(compilation);
+
+	resolve_target(compilation);
+	compilation->cache.hits = 0;
+	compilation->cache.misses = 0;
+	if (compilation->options.cache_dir != NULL) {
+		// Objects depend on everything given to emit_object
+		char *target_triple = LLVMGetDefaultTargetTriple();
+		char *passes = compilation->options.passes != NULL ? compilation->options.passes : "";
+		char *cache_options = malloc(strlen(target_triple) + strlen(passes) + strlen(compilation->cpu) + strlen(compilation->features) + 48);
+		sprintf(cache_options, "%s -O%c --passes=%s -mcpu=%s -mattr=%s", target_triple, compilation->options.opt_level, passes, compilation->cpu, compilation->features);
+		cache_initialize(&compilation->cache, compilation->options.cache_dir, compilation->options.cache_limit, cache_options);
+		free(cache_options);
+		LLVMDisposeMessage(target_triple);
+	}
+	return compilation;
+}
+
+// An object depends on the path of its module, since names are mangled
+// with it, the source and the interfaces of its imports. Changing only the
+// bodies of an import doesn't rebuild its importers.
+static void hash_module(Module *module, bool entry) {
+	hash_init(&module->hash);
+	hash_update(&module->hash, &entry, sizeof(entry));
+	hash_update(&module->hash, &module->source_hash, sizeof(Hash));
+	for (int i = 0; i < module->imports.length; i++) {
+		Module *import = LIST_GET(Module *, &module->imports, i);
+		hash_update(&module->hash, &import->interface_hash, sizeof(Hash));
+	}
+}
+
+// Remembers the functions llvm_module uses from other modules, so std only
+// has to link those
+static void add_references(ModuleGraph *graph, LLVMModuleRef llvm_module) {
+	pthread_mutex_lock(&graph->lock);
+	for (LLVMValueRef function = LLVMGetFirstFunction(llvm_module); function != NULL; function = LLVMGetNextFunction(function)) {
+		if (!LLVMIsDeclaration(function)) {
+			continue;
+		}
+		size_t length;
+		const char *name = LLVMGetValueName2(function, &length);
+		String key = { .p = (char *)name, .length = length };
+		if (table_get(&graph->references, key) == NULL) {
+			char *reference = String_to_cstring(key);
+			table_put(&graph->references, (String) { .p = reference, .length = length }, reference);
+		}
+	}
+	pthread_mutex_unlock(&graph->lock);
+}
+
+// Stores the functions a cached object declares next to it, so std still
+// knows what to keep when the object is reused
+static void store_references(Compilation *compilation, Module *module, LLVMModuleRef llvm_module) {
+	char *path = cache_path(&compilation->cache, module->hash, ".refs");
+	char *temporary = cache_temporary(path);
+	FILE *file = fopen(temporary, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Epic fail, unable to write %s\n", temporary);
+		exit(1);
+	}
+	for (LLVMValueRef function = LLVMGetFirstFunction(llvm_module); function != NULL; function = LLVMGetNextFunction(function)) {
+		if (LLVMIsDeclaration(function)) {
+			fprintf(file, "%s\n", LLVMGetValueName(function));
+		}
+	}
+	fclose(file);
+	cache_store(temporary, path);
+	free(temporary);
+	free(path);
+}
+
+// Adds the references stored with a cached object, false if they were
+// evicted
+static bool load_references(Compilation *compilation, Module *module) {
+	ModuleGraph *graph = &compilation->graph;
+	char *path = cache_path(&compilation->cache, module->hash, ".refs");
+	if (!cache_touch(path)) {
+		free(path);
+		return false;
+	}
+	char *data;
+	size_t size = read_file_from_path(path, &data);
+	for (size_t start = 0, end = 0; end < size; end++) {
+		if (data[end] != '\n') {
+			continue;
+		}
+		String key = { .p = data + start, .length = end - start };
+		if (table_get(&graph->references, key) == NULL) {
+			char *reference = String_to_cstring(key);
+			table_put(&graph->references, (String) { .p = reference, .length = key.length }, reference);
+		}
+		start = end + 1;
+	}
+	release_file(data, size);
+	free(path);
+	return true;
+}
+
+// Generates and emits one module in its own LLVM context, std modules are
+// already generated from their bitcode
+static void emit_module(void *argument, int worker) {
+	Module *module = argument;
+	ModuleGraph *graph = module->graph;
+	Compilation *compilation = graph->compilation;
+	memory_enter(&compilation->memory, MEMORY_CODEGEN);
+
+	LLVMModuleRef llvm_module = module->llvm_module;
+	if (llvm_module == NULL) {
+		llvm_module = build_module(compilation, LLVMContextCreate(), module->file_node, module->dir, module->path, module == graph->main);
+		verify_module(llvm_module, compilation);
+		add_references(graph, llvm_module);
+	}
+	if (compilation->options.cache_dir != NULL) {
+		if (module->std == NULL) {
+			store_references(compilation, module, llvm_module);
+		}
+		char *temporary = cache_temporary(module->object);
+		emit_object(llvm_module, compilation, temporary);
+		cache_store(temporary, module->object);
+		free(temporary);
+	} else {
+		emit_object(llvm_module, compilation, module->object);
+	}
+	if (llvm_module != module->llvm_module) {
+		dispose_module(llvm_module);
+	}
+}
+
+// Deletes the internal functions and globals nothing uses, until every
+// one left is used
+static void strip_unused(LLVMModuleRef llvm_module) {
+	bool stripped = true;
+	while (stripped) {
+		stripped = false;
+		LLVMValueRef function = LLVMGetFirstFunction(llvm_module);
+		while (function != NULL) {
+			LLVMValueRef next = LLVMGetNextFunction(function);
+			if (LLVMGetLinkage(function) == LLVMInternalLinkage && LLVMGetFirstUse(function) == NULL) {
+				LLVMDeleteFunction(function);
+				stripped = true;
+			}
+			function = next;
+		}
+		LLVMValueRef global = LLVMGetFirstGlobal(llvm_module);
+		while (global != NULL) {
+			LLVMValueRef next = LLVMGetNextGlobal(global);
+			LLVMLinkage linkage = LLVMGetLinkage(global);
+			bool local = linkage == LLVMInternalLinkage || linkage == LLVMPrivateLinkage;
+			if (local && LLVMGetFirstUse(global) == NULL) {
+				LLVMDeleteGlobal(global);
+				stripped = true;
+			}
+			global = next;
+		}
+	}
+}
+
+// Loads the bitcode of a std module and keeps only the functions that are
+// referenced, by generated importers or the references of cached ones
+static void link_std(Module *module) {
+	ModuleGraph *graph = module->graph;
+	module->llvm_module = std_load(module->std, LLVMContextCreate());
+
+	for (LLVMValueRef function = LLVMGetFirstFunction(module->llvm_module); function != NULL; function = LLVMGetNextFunction(function)) {
+		size_t length;
+		const char *name = LLVMGetValueName2(function, &length);
+		String key = { .p = (char *)name, .length = length };
+		if (!LLVMIsDeclaration(function) && table_get(&graph->references, key) == NULL) {
+			LLVMSetLinkage(function, LLVMInternalLinkage);
+		}
+	}
+	strip_unused(module->llvm_module);
+	add_references(graph, module->llvm_module);
+
+	// The object depends on which functions are kept
+	hash_module(module, false);
+	for (LLVMValueRef function = LLVMGetFirstFunction(module->llvm_module); function != NULL; function = LLVMGetNextFunction(function)) {
+		size_t length;
+		const char *name = LLVMGetValueName2(function, &length);
+		hash_update(&module->hash, name, length + 1);
+	}
+}
+
+// Everything but main and the functions declared extern is only called
+// from within the program, so it is internal and uses the fast calling
+// convention
+static void internalize(LLVMModuleRef program) {
+	for (LLVMValueRef function = LLVMGetFirstFunction(program); function != NULL; function = LLVMGetNextFunction(function)) {
+		if (LLVMIsDeclaration(function) || strcmp(LLVMGetValueName(function), "main") == 0) {
+			continue;
+		}
+		LLVMSetLinkage(function, LLVMInternalLinkage);
+		LLVMSetFunctionCallConv(function, LLVMFastCallConv);
+	}
+
+	for (LLVMValueRef function = LLVMGetFirstFunction(program); function != NULL; function = LLVMGetNextFunction(function)) {
+		for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block != NULL; block = LLVMGetNextBasicBlock(block)) {
+			for (LLVMValueRef instruction = LLVMGetFirstInstruction(block); instruction != NULL; instruction = LLVMGetNextInstruction(instruction)) {
+				if (LLVMIsACallInst(instruction) == NULL) {
+					continue;
+				}
+				LLVMValueRef callee = LLVMGetCalledValue(instruction);
+				if (LLVMIsAFunction(callee) != NULL) {
+					LLVMSetInstructionCallConv(instruction, LLVMGetFunctionCallConv(callee));
+				}
+			}
+		}
+	}
+}
+
+// Links every module into one and emits it as a single object, so calls
+// across modules are inlined and unused functions removed. Modules share
+// one context, so they are generated serially and objects aren't cached.
+static void compile_whole_program(Compilation *compilation, char *output) {
+	ModuleGraph *graph = &compilation->graph;
+	memory_enter(&compilation->memory, MEMORY_CODEGEN);
+	LLVMContextRef context = LLVMContextCreate();
+	char *name = path_to_name(graph->main->path);
+	LLVMModuleRef program = LLVMModuleCreateWithNameInContext(name, context);
+	for (int i = 0; i < graph->order.length; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		LLVMModuleRef llvm_module;
+		if (module->std != NULL) {
+			llvm_module = std_load(module->std, context);
+		} else {
+			char *module_name = module == graph->main ? name : module->path;
+			llvm_module = build_module(compilation, context, module->file_node, module->dir, module_name, module == graph->main);
+		}
+		Timer timer = timer_start(&compilation->timings);
+		if (LLVMLinkModules2(program, llvm_module)) {
+			fprintf(stderr, "Epic fail: unable to link %s into the program\n", module->path);
+			exit(1);
+		}
+		timer_stop(&compilation->timings, timer, "link modules", module->path, NULL);
+	}
+	verify_module(program, compilation);
+
+	Timer timer = timer_start(&compilation->timings);
+	internalize(program);
+	LLVMPassBuilderOptionsRef pass_options = LLVMCreatePassBuilderOptions();
+	LLVMErrorRef error = LLVMRunPasses(program, "ipsccp,cgscc(inline),globaldce", NULL, pass_options);
+	LLVMDisposePassBuilderOptions(pass_options);
+	if (error != NULL) {
+		char *message = LLVMGetErrorMessage(error);
+		fprintf(stderr, "Epic fail: whole program passes: %s\n", message);
+		LLVMDisposeErrorMessage(message);
+		exit(1);
+	}
+	timer_stop(&compilation->timings, timer, "whole program", name, NULL);
+
+	char *object = malloc(strlen(output) + 3);
+	sprintf(object, "%s.o", output);
+	emit_object(program, compilation, object);
+	dispose_module(program);
+	timer = timer_start(&compilation->timings);
+	link_objects(&object, 1, output, true);
+	timer_stop(&compilation->timings, timer, "link", NULL, NULL);
+	free(object);
+	free(name);
+}
+
+void penquin_cache_stats(Compilation *compilation, int *hits, int *misses) {
+	*hits = compilation->cache.hits;
+	*misses = compilation->cache.misses;
+}
+
+// Emits the object of every module that isn't in the cache. Without a
+// cache objects are named after output so compilations with different
+// outputs don't clobber each other.
+static void emit_objects(Compilation *compilation, char *output) {
+	ModuleGraph *graph = &compilation->graph;
+	memory_enter(&compilation->memory, MEMORY_CODEGEN);
+	bool cache = compilation->options.cache_dir != NULL;
+	int count = graph->order.length;
+	for (int i = 0; i < count; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		if (cache && module->std == NULL) {
+			hash_module(module, module == graph->main);
+			module->object = cache_lookup(&compilation->cache, module->hash, &module->cached);
+			if (module->cached && !load_references(compilation, module)) {
+				// Without its references std can't be stripped, emit it again
+				module->cached = false;
+				compilation->cache.hits--;
+				compilation->cache.misses++;
+			}
+		} else if (!cache) {
+			module->object = malloc(strlen(output) + 16);
+			sprintf(module->object, "%s.%d.o", output, i);
+		}
+	}
+
+	module_graph_parse_stubs(graph);
+	module_graph_check(graph);
+	for (int i = 0; i < count; i++) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		if (!module->cached && module->std == NULL) {
+			pool_submit(&compilation->pool, emit_module, module);
+		}
+	}
+	pool_wait(&compilation->pool);
+
+	// std is linked once everything that references it is generated, the
+	// importers of a std module come after it in the order
+	for (int i = count - 1; i >= 0; i--) {
+		Module *module = LIST_GET(Module *, &graph->order, i);
+		if (module->std == NULL) {
+			continue;
+		}
+		Timer timer = timer_start(&compilation->timings);
+		link_std(module);
+		timer_stop(&compilation->timings, timer, "link std", module->path, NULL);
+		if (cache) {
+			module->object = cache_lookup(&compilation->cache, module->hash, &module->cached);
+		}
+		if (!module->cached) {
+			pool_submit(&compilation->pool, emit_module, module);
+		}
+	}
+	pool_wait(&compilation->pool);
+}
+
+void penquin_compile(Compilation *compilation, char *path, char *output) {
+	ModuleGraph *graph = &compilation->graph;
+	module_graph_load(graph, path);
+	if (compilation->options.whole_program) {
+		module_graph_parse_stubs(graph);
+		module_graph_check(graph);
+		compile_whole_program(compilation, output);
+		return;
+	}
+
+	emit_objects(compilation, output);
+	bool cache = compilation->options.cache_dir != NULL;
+	int count = graph->order.length;
+	char **objects = malloc(sizeof(char *) * count);
+	for (int i = 0; i < count; i++) {
+		objects[i] = LIST_GET(Module *, &graph->order, i)->object;
+	}
+	Timer timer = timer_start(&compilation->timings);
+	link_objects(objects, count, output, !cache);
+	timer_stop(&compilation->timings, timer, "link", NULL, NULL);
+	if (cache) {
+		cache_evict(&compilation->cache);
+	}
+	free(objects);
+}
+
+// With a cache the JIT runs the cached objects, the ones that are missing
+// are emitted first. Without one it compiles the modules itself.
+int penquin_run(Compilation *compilation, char *path) {
+	ModuleGraph *graph = &compilation->graph;
+	module_graph_load(graph, path);
+	if (compilation->options.cache_dir == NULL) {
+		module_graph_parse_stubs(graph);
+		module_graph_check(graph);
+		return jit_run(compilation);
+	}
+
+	emit_objects(compilation, NULL);
+	cache_evict(&compilation->cache);
+	return jit_run(compilation);
+}
+
+void penquin_emit_std(Compilation *compilation, char *path, char *dir) {
+	ModuleGraph *graph = &compilation->graph;
+	char *name = path_to_name(path);
+	char *std_path = malloc(strlen(name) + 5);
+	sprintf(std_path, "std:%s", name);
+	module_graph_load(graph, std_path);
+	module_graph_parse_stubs(graph);
+	module_graph_check(graph);
+
+	Module *module = graph->main;
+	LLVMModuleRef llvm_module = build_module(compilation, LLVMContextCreate(), module->file_node, module->dir, module->path, false);
+	verify_module(llvm_module, compilation);
+
+	char *output = malloc(strlen(dir) + strlen(name) + 6);
+	sprintf(output, "%s/%s.bc", dir, name);
+	if (LLVMWriteBitcodeToFile(llvm_module, output)) {
+		fprintf(stderr, "Epic fail: unable to write %s\n", output);
+		exit(1);
+	}
+	sprintf(output, "%s/%s.pqi", dir, name);
+	interface_write(module->file_node, output);
+
+	dispose_module(llvm_module);
+	free(output);
+	free(std_path);
+	free(name);
+}
+
+void penquin_destroy(Compilation *compilation) {
+	int jobs = compilation->options.jobs;
+	pool_destroy(&compilation->pool);
+	if (compilation->options.time_report) {
+		timings_report(&compilation->timings, stderr);
+	}
+	if (compilation->options.trace != NULL) {
+		timings_write_trace(&compilation->timings, compilation->options.trace);
+	}
+	timings_free(&compilation->timings);
+	memory_enter(NULL, MEMORY_SETUP);
+	if (compilation->options.mem_report) {
+		memory_report(&compilation->memory, stderr);
+		Arena total = compilation->arena;
+		for (int i = 0; i < jobs; i++) {
+			total.allocated += compilation->arenas[i].allocated;
+			total.reserved += compilation->arenas[i].reserved;
+			total.chunks += compilation->arenas[i].chunks;
+		}
+		fprintf(stderr, "arena: %zu bytes allocated, %zu bytes reserved in %d chunks\n",
+				total.allocated, total.reserved, total.chunks);
+	}
+	module_graph_free(&compilation->graph);
+	resolver_free(compilation);
+	if (compilation->options.cache_dir != NULL) {
+		cache_free(&compilation->cache);
+	}
+	for (int i = 0; i < jobs; i++) {
+		arena_free(&compilation->arenas[i]);
+	}
+	free(compilation->arenas);
+	arena_free(&compilation->arena);
+	type_free(&compilation->types);
+	symbol_free(&compilation->symbols);
+	free(compilation->cpu);
+	free(compilation->features);
+	free(compilation);
+}
@@ -0,0 +1,55 @@
+#ifndef PENQUIN_H
+#define PENQUIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PENQUIN_VERSION "0.1.0"
+
+// libpenquin. A compilation owns all of its state, so several compilations
+// can run in one process at the same time on different threads. Errors in
+// the compiled program are reported on stderr and exit the process.
+typedef struct Compilation Compilation;
+
+typedef struct {
+	bool huge_pages;
+	int jobs; // worker threads, 0 for one per CPU
+	char *cache_dir; // objects of unchanged modules are reused from here
+	size_t cache_limit; // bytes
+	char *std_dir; // std is compiled from the source here instead of embedded
+	char opt_level; // '0' to '3', or 's' to optimize for size
+	char *passes; // pipeline run instead of the default one of opt_level
+	bool whole_program; // link every module into one before optimizing
+	char *cpu; // target CPU, "native" for the host's with its features
+	char *features; // like +avx2,-sse4a, added to the CPU's
+	bool lazy; // penquin_run compiles each function when it is first called
+	bool time_report; // time of each phase and module, on stderr
+	char *trace; // Chrome trace of the phases is written here
+	bool mem_report; // allocations of each phase and peak RSS, on stderr
+	// Dumps of each module, written to its name with the extension of the
+	// dump in the working directory
+	bool dump_tokens; // .tokens
+	bool dump_ast;    // .ast
+	bool emit_llvm;   // .ll, after optimization
+	bool emit_asm;    // .s
+	bool verify;      // LLVM modules before they are optimized
+} PenquinOptions;
+
+// Module objects reused from and added to the cache by penquin_compile
+void         penquin_cache_stats(Compilation *compilation, int *hits, int *misses);
+// Compiles the program whose main is in path into the executable output,
+// a compilation compiles one program
+void         penquin_compile(Compilation *compilation, char *path, char *output);
+Compilation *penquin_create(PenquinOptions *options);
+// Compiles the program whose main is in path in process with the JIT and
+// runs it, returning what main returns
+int          penquin_run(Compilation *compilation, char *path);
+// Reads declarations and statements from stdin and runs each statement as
+// soon as it is complete, until the end of the input
+void         penquin_repl(Compilation *compilation);
+void         penquin_destroy(Compilation *compilation);
+// Compiles the std module in path into the bitcode and interface in dir
+// that are embedded into penquin, std_dir has to be set
+void         penquin_emit_std(Compilation *compilation, char *path, char *dir);
+
+#endif
@@ -0,0 +1,104 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+typedef struct {
+	Pool *pool;
+	int index;
+} Worker;
+
+static void *run_worker(void *argument) {
+	Worker *worker = argument;
+	Pool *pool = worker->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->next_job == pool->jobs.length && !pool->stopping) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		if (pool->next_job == pool->jobs.length) {
+			break;
+		}
+
+		PoolJob job = LIST_GET(PoolJob, &pool->jobs, pool->next_job++);
+		if (pool->next_job == pool->jobs.length) {
+			pool->next_job = 0;
+			pool->jobs.length = 0;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		job.task(job.argument, worker->index);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->unfinished == 0) {
+			pthread_cond_broadcast(&pool->idle);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	free(worker);
+	return NULL;
+}
+
+int pool_default_workers() {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : n;
+}
+
+void pool_init(Pool *pool, int workers) {
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	list_init(&pool->jobs, sizeof(PoolJob));
+	pool->next_job = 0;
+	pool->unfinished = 0;
+	pool->stopping = false;
+	pool->workers = workers;
+	pool->threads = malloc(sizeof(pthread_t) * workers);
+
+	for (int i = 0; i < workers; i++) {
+		Worker *worker = malloc(sizeof(Worker));
+		worker->pool = pool;
+		worker->index = i;
+		if (pthread_create(&pool->threads[i], NULL, run_worker, worker) != 0) {
+			fprintf(stderr, "Unable to start worker thread\n");
+			exit(1);
+		}
+	}
+}
+
+// Tasks may submit further tasks
+void pool_submit(Pool *pool, PoolTask task, void *argument) {
+	PoolJob job = { .task = task, .argument = argument };
+	pthread_mutex_lock(&pool->lock);
+	list_add(&pool->jobs, &job);
+	pool->unfinished++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Waits until every submitted task, including ones submitted by tasks, is done
+void pool_wait(Pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->unfinished != 0) {
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(Pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->workers; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	free(pool->threads);
+	free(pool->jobs.elements);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->idle);
+}
@@ -0,0 +1,35 @@
+#ifndef PENQUIN_POOL_H
+#define PENQUIN_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "list.h"
+
+// Tasks get the index of the worker running them, so they can use
+// per-worker state such as arenas
+typedef void (*PoolTask)(void *argument, int worker);
+
+typedef struct {
+	PoolTask task;
+	void *argument;
+} PoolJob;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	List jobs;
+	int next_job;
+	int unfinished;
+	bool stopping;
+	int workers;
+	pthread_t *threads;
+} Pool;
+
+int  pool_default_workers();
+void pool_destroy(Pool *pool);
+void pool_init(Pool *pool, int workers);
+void pool_submit(Pool *pool, PoolTask task, void *argument);
+void pool_wait(Pool *pool);
+
+#endif
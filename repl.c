@@ -0,0 +1,220 @@
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <llvm-c/Orc.h>
+#include "penquin.h"
+#include "arena.h"
+#include "codegen.h"
+#include "common.h"
+#include "compilation.h"
+#include "jit.h"
+#include "module.h"
+#include "parser.h"
+#include "resolver.h"
+#include "typechecker.h"
+
+// Everything entered is a module named repl. Declarations stay in the
+// global scope, so later input uses them without compiling them again,
+// statements are compiled into a function of their own that is called
+// right away. Variables they assign first are globals, so later input uses
+// them too. Imports are kept and put in front of all later input. Input
+// with an error is reported and dropped.
+typedef struct {
+	Compilation *compilation;
+	Jit *jit;
+	char *imports;
+	int statements;
+	int declarations; // entries of the global scope kept when input fails
+} Repl;
+
+// Whether input starts with keyword as a whole word, not a name like funny
+static bool starts_with_keyword(char *input, char *keyword) {
+	while (*input == ' ' || *input == '\t' || *input == '\n') {
+		input++;
+	}
+	size_t length = strlen(keyword);
+	char next = input[length];
+	bool name = (next >= 'a' && next <= 'z') || (next >= 'A' && next <= 'Z') || (next >= '0' && next <= '9') || next == '_';
+	return strncmp(input, keyword, length) == 0 && !name;
+}
+
+// Input is complete once its braces are closed and it ends a statement or
+// a block, or is an import
+static bool is_complete(char *input) {
+	int depth = 0;
+	bool in_string = false;
+	char last = '\0';
+	for (char *c = input; *c != '\0'; c++) {
+		if (*c == '"') {
+			in_string = !in_string;
+		} else if (!in_string && (*c == '{' || *c == '(')) {
+			depth++;
+		} else if (!in_string && (*c == '}' || *c == ')')) {
+			depth--;
+		}
+		if (*c != ' ' && *c != '\t' && *c != '\n') {
+			last = *c;
+		}
+	}
+	bool import = starts_with_keyword(input, "import");
+	return depth <= 0 && !in_string && (last == ';' || last == '}' || (import && last == '"'));
+}
+
+static bool is_declaration(char *input) {
+	return starts_with_keyword(input, "fun") || starts_with_keyword(input, "extern") || starts_with_keyword(input, "import");
+}
+
+// Modules that don't exist are reported here, loading them fails on a
+// worker which ends the session
+static bool module_exists(Compilation *compilation, char *path) {
+	if (strncmp(path, "std:", 4) != 0) {
+		return access(path, R_OK) == 0;
+	}
+	return compilation->options.std_dir != NULL || std_module(path) != NULL;
+}
+
+// Loads, checks and adds to the JIT the modules imported for the first
+// time, and keeps the import for later input
+static void add_imports(Repl *repl, AstNode *file_node) {
+	ModuleGraph *graph = &repl->compilation->graph;
+	List *nodes = &file_node->as.file.nodes;
+	for (int i = 0; i < nodes->length; i++) {
+		AstNode *node = LIST_GET(AstNode *, nodes, i);
+		if (node->type != AST_IMPORT) {
+			continue;
+		}
+		char *path = resolve_module_path(".", node->as.import.path);
+		if (!module_exists(repl->compilation, path)) {
+			fprintf(stderr, "Epic fail: no module %s\n", path);
+			free(path);
+			fail();
+		}
+		if (table_get(&graph->modules, STRING(path)) == NULL) {
+			int first = graph->order.length;
+			module_graph_add(graph, path);
+			module_graph_parse_stubs(graph);
+			module_graph_check(graph);
+			for (int j = first; j < graph->order.length; j++) {
+				jit_add_module(repl->jit, LIST_GET(Module *, &graph->order, j));
+			}
+
+			String import = node->as.import.path;
+			size_t length = strlen(repl->imports);
+			repl->imports = realloc(repl->imports, length + import.length + 11);
+			sprintf(repl->imports + length, "import \"%.*s\"\n", import.length, import.p);
+		}
+		free(path);
+	}
+}
+
+// Removes what input that failed added to the global scope, everything
+// after the first length entries
+static void forget_declarations(Table *locals, int length) {
+	int i = 0;
+	TableEntry *entry;
+	while (table_next(locals, &i, &entry)) {
+		if (length > 0) {
+			length--;
+		} else {
+			table_remove(locals, entry->key);
+		}
+	}
+}
+
+static void evaluate(Repl *repl, char *input) {
+	Compilation *compilation = repl->compilation;
+	Arena *arena = &compilation->arenas[0];
+	Table *globals = compilation->global_scope.locals;
+	repl->declarations = globals->length;
+	jmp_buf recovery;
+	if (setjmp(recovery) != 0) {
+		fail_recover(NULL);
+		forget_declarations(globals, repl->declarations);
+		return;
+	}
+	fail_recover(&recovery);
+
+	// Names in the AST point into the source, so it lives as long as the
+	// compilation
+	bool declaration = is_declaration(input);
+	char function[32];
+	sprintf(function, "__repl_%d", repl->statements);
+	size_t size = strlen(repl->imports) + strlen(input) + sizeof(function) + 16;
+	char *source = arena_alloc(arena, size);
+	if (declaration) {
+		sprintf(source, "%s%s", repl->imports, input);
+	} else {
+		sprintf(source, "%sfun %s() {\n%s\n}\n", repl->imports, function, input);
+		repl->statements++;
+	}
+
+	memory_enter(&compilation->memory, MEMORY_PARSE);
+	AstNode *file_node = parse_file(compilation, arena, "repl", source);
+	List *nodes = &file_node->as.file.nodes;
+	if (!declaration) {
+		LIST_GET(AstNode *, nodes, nodes->length - 1)->as.fn.globals = true;
+	}
+	add_imports(repl, file_node);
+	// Imported modules stay loaded
+	repl->declarations = globals->length;
+	memory_enter(&compilation->memory, MEMORY_RESOLVE);
+	resolve(compilation, file_node, ".");
+	memory_enter(&compilation->memory, MEMORY_TYPECHECK);
+	resolve_types(compilation, file_node);
+
+	memory_enter(&compilation->memory, MEMORY_CODEGEN);
+	LLVMOrcThreadSafeContextRef context = LLVMOrcCreateNewThreadSafeContext();
+	LLVMModuleRef module = build_module(compilation, LLVMOrcThreadSafeContextGetContext(context), file_node, ".", "repl", false);
+	verify_module(module, compilation);
+	jit_add(repl->jit, module, context);
+	LLVMOrcDisposeThreadSafeContext(context);
+
+	if (!declaration) {
+		AstNode *wrapper = LIST_GET(AstNode *, nodes, nodes->length - 1);
+		void (*statements)(void) = jit_lookup(repl->jit, wrapper->as.fn.symbol->name.p);
+		fail_recover(NULL);
+		statements();
+		fflush(stdout);
+	}
+	fail_recover(NULL);
+}
+
+void penquin_repl(Compilation *compilation) {
+	Repl repl;
+	repl.compilation = compilation;
+	repl.jit = jit_create(compilation);
+	repl.imports = cstring_duplicate("");
+	repl.statements = 0;
+	repl.declarations = 0;
+
+	bool interactive = isatty(STDIN_FILENO);
+	size_t capacity = 256;
+	char *input = malloc(capacity);
+	input[0] = '\0';
+	char line[1024];
+	while (true) {
+		if (interactive) {
+			printf(input[0] == '\0' ? "> " : "... ");
+			fflush(stdout);
+		}
+		if (fgets(line, sizeof(line), stdin) == NULL) {
+			break;
+		}
+		size_t length = strlen(input) + strlen(line) + 1;
+		if (length > capacity) {
+			capacity = length * 2;
+			input = realloc(input, capacity);
+		}
+		strcat(input, line);
+		if (is_complete(input)) {
+			evaluate(&repl, input);
+			input[0] = '\0';
+		}
+	}
+
+	free(input);
+	free(repl.imports);
+	jit_destroy(repl.jit);
+}
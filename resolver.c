@@ -3,30 +3,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include "resolver.h"
+#include "arena.h"
 #include "common.h"
+#include "compilation.h"
 #include "list.h"
+#include "memory.h"
 #include "parser.h"
+#include "symbol.h"
 #include "table.h"
 
-static char *module_path;
-static char *module_dir;
-static Scope *current_scope;
-static Scope global_scope;
-static Table *modules;
+// State of resolving one module, the global scope is shared by every module
+// of the compilation
+typedef struct {
+	Compilation *compilation;
+	Symbol *module_symbol;
+	Symbol *main_symbol;
+	char *module_dir;
+	Scope *current_scope;
+	Scope *globals; // of a function with globals, what is first assigned in it is global
+} Resolver;
 
 char *resolve_module_path(char *dir, String module_name) {
+	// std modules are named by what they are imported as, they are embedded
+	// in the compiler instead of found relative to anything
 	if (String_starts_with(module_name, "std:")) {
-		int size = 2 + module_name.length - 4 + 3 + 1;
-		char *full_path = malloc(size);
-		memcpy(full_path, "./std/", 6);
-		memcpy(full_path + 6, module_name.p + 4, module_name.length - 4);
-		memcpy(full_path + 6 + module_name.length - 4, ".pq", 4);
-		return full_path;
+		return String_to_cstring(module_name);
 	}
 
 	int dirlen = strlen(dir);
 	int size = dirlen + 1 + module_name.length + 3 + 1;
 	char *full_path = malloc(size);
+	memory_count(MEMORY_STRINGS, size);
 	memcpy(full_path, dir, dirlen);
 	full_path[dirlen] = '/';
 	memcpy(full_path + dirlen + 1, module_name.p, module_name.length);
@@ -34,135 +41,149 @@ char *resolve_module_path(char *dir, String module_name) {
 	return full_path;
 }
 
-static char *resolve_identifier_name(char *path, String name) {
-	int plen = strlen(path);
-	char prefix[plen + 2];
-	memcpy(prefix, path, plen);
-	prefix[plen] = '@';
-	prefix[plen + 1] = '\0';
-	return cstring_concat_String(prefix, name);
-}
-
-static char *resolve_identifier(String name, bool external) {
-	if (external || String_cmp_cstring(name, "main") == 0) {
-		return String_to_cstring(name);
+static Symbol *resolve_identifier(Resolver *resolver, Symbol *name, bool external) {
+	if (external || name == resolver->main_symbol) {
+		return name;
 	} else {
-		return resolve_identifier_name(module_path, name);
+		return symbol_qualify(&resolver->compilation->symbols, resolver->module_symbol, name);
 	}
 }
 
-static AstNode *lookup_identifier(String name) {
-	char *global_name = resolve_identifier(name, false);
+static AstNode *lookup_identifier(Resolver *resolver, Symbol *name) {
+	Symbol *global_name = resolve_identifier(resolver, name, false);
 
 	AstNode *declaration_node = NULL;
-	Scope *scope = current_scope;
+	Scope *scope = resolver->current_scope;
 	while (scope != NULL && declaration_node == NULL) {
-		String lookup_name = scope->locals == global_scope.locals ? STRING(global_name) : name;
-		declaration_node = (AstNode *)table_get(scope->locals, lookup_name);
+		Symbol *lookup_name = scope->locals == resolver->compilation->global_scope.locals ? global_name : name;
+		declaration_node = (AstNode *)table_get_hashed(scope->locals, lookup_name->name, lookup_name->hash);
 		scope = scope->prev;
 	}
 
 	if (declaration_node == NULL) {
 		// External declarations, could be moved to separate private place
-		declaration_node = (AstNode *)table_get(global_scope.locals, name);
+		declaration_node = (AstNode *)table_get_hashed(resolver->compilation->global_scope.locals, name->name, name->hash);
 	}
 
-	free(global_name);
 	return declaration_node;
 }
 
-static Scope *create_scope() {
-	Table *locals = malloc(sizeof(Table));
+static Scope *create_scope(Resolver *resolver) {
+	Table *locals = arena_alloc(&resolver->compilation->arena, sizeof(Table));
     table_init(locals);
 
-    Scope *block_scope = malloc(sizeof(Scope));
-    block_scope->prev = current_scope;
+    Scope *block_scope = arena_alloc(&resolver->compilation->arena, sizeof(Scope));
+	memory_count(MEMORY_SCOPES, sizeof(Table) + sizeof(Scope));
+    block_scope->prev = resolver->current_scope;
     block_scope->locals = locals;
-    current_scope = block_scope;
+    resolver->current_scope = block_scope;
+	list_add(&resolver->compilation->scopes, &block_scope);
     return block_scope;
 }
 
-static void parse_node(AstNode *node);
+static void parse_node(Resolver *resolver, AstNode *node);
 
-static void parse_accessor(AstNode *node) {
-	AstNode *file_node = lookup_identifier(node->as.accessor.left->as.variable.name);
+static void parse_accessor(Resolver *resolver, AstNode *node) {
+	AstNode *file_node = lookup_identifier(resolver, node->as.accessor.left->as.variable.symbol);
 	File *file = &file_node->as.file;
-	char *current_module_path = module_path;
-	module_path = file->path;
+	Symbol *current_module_symbol = resolver->module_symbol;
+	resolver->module_symbol = file->module;
 
 	// Looks up in current file
-	parse_node(node->as.accessor.left);
+	parse_node(resolver, node->as.accessor.left);
 
-	Scope *scope = current_scope;
-	current_scope = file->scope;
+	Scope *scope = resolver->current_scope;
+	resolver->current_scope = file->scope;
 
 	// Looks up in current file
-	parse_node(node->as.accessor.right);
+	parse_node(resolver, node->as.accessor.right);
 
-	current_scope = scope;
-	module_path = current_module_path;
+	resolver->current_scope = scope;
+	resolver->module_symbol = current_module_symbol;
 }
 
-static void parse_array(AstNode *node) {
+static void parse_array(Resolver *resolver, AstNode *node) {
 	for (int i = 0; i < node->as.array.items.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &node->as.array.items, i);
-		parse_node(i_node);
+		parse_node(resolver, i_node);
 	}
 }
 
-static void parse_assignment(AstNode *node) {
-	AstNode *declaration_node = lookup_identifier(node->as.assignment.name);
+static void parse_assignment(Resolver *resolver, AstNode *node) {
+	Symbol *symbol = node->as.assignment.symbol;
+	AstNode *declaration_node = lookup_identifier(resolver, symbol);
 	if (declaration_node == NULL) {
-		char *name = resolve_identifier(node->as.assignment.name, current_scope->locals != global_scope.locals);
-		table_put(current_scope->locals, STRING(name), node);
+		Scope *scope = resolver->current_scope;
+		bool global = scope == resolver->globals || scope->locals == resolver->compilation->global_scope.locals;
+		Symbol *name = resolve_identifier(resolver, symbol, !global);
+		if (global) {
+			scope = &resolver->compilation->global_scope;
+			node->as.assignment.global = name;
+		}
+		table_put_hashed(scope->locals, name->name, name->hash, node);
 		declaration_node = node;
-	} else {
-		assert(declaration_node->as.assignment.type_info == NULL);
+	} else if (declaration_node->type == AST_FUNCTION || declaration_node->type == AST_FILE) {
+		fprintf(stderr, "Epic fail, %s is not a variable.\n", symbol->name.p);
+		fail();
+	} else if (node->as.assignment.type_info != NULL) {
+		fprintf(stderr, "Epic fail, %s is already declared.\n", symbol->name.p);
+		fail();
 	}
 	node->as.assignment.initial = declaration_node;
 	if (node->as.assignment.value != NULL) {
-		parse_node(node->as.assignment.value);
+		parse_node(resolver, node->as.assignment.value);
 	}
 }
 
-static void parse_block(AstNode *node) {
-    node->as.block.scope = create_scope();
+static void parse_block(Resolver *resolver, AstNode *node) {
+    node->as.block.scope = create_scope(resolver);
 	for (int i = 0; i < node->as.block.statements.length; i++) {
 		AstNode *stmnt = LIST_GET(AstNode *, &node->as.block.statements, i);
-		parse_node(stmnt);
+		parse_node(resolver, stmnt);
 	}
-	current_scope = current_scope->prev;
+	resolver->current_scope = resolver->current_scope->prev;
 }
 
-static void parse_file_node(AstNode *node) {
-	module_path = node->as.file.path;
-	node->as.file.scope = create_scope();
+static void parse_file_node(Resolver *resolver, AstNode *node) {
+	resolver->module_symbol = node->as.file.module;
+	node->as.file.scope = create_scope(resolver);
 	for (int i = 0; i < node->as.file.nodes.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &node->as.file.nodes, i);
-		parse_node(i_node);
+		parse_node(resolver, i_node);
 	}
-	current_scope = current_scope->prev;
-	module_path = NULL;
+	resolver->current_scope = resolver->current_scope->prev;
+	resolver->module_symbol = NULL;
 }
 
-static void parse_function(AstNode *node) {
-	char *name = resolve_identifier(node->as.fn.name, node->as.fn.external);
+static void parse_function(Resolver *resolver, AstNode *node) {
+	Symbol *name = resolve_identifier(resolver, symbol_intern(&resolver->compilation->symbols, node->as.fn.name), node->as.fn.external);
+	node->as.fn.symbol = name;
 
 	// TODO: put private functions in file scope
-	table_put(global_scope.locals, STRING(name), node);
+	Table *globals = resolver->compilation->global_scope.locals;
+	AstNode *previous = table_get_hashed(globals, name->name, name->hash);
+	bool defined = previous != NULL && previous != node && previous->type == AST_FUNCTION && previous->as.fn.statements.elements != NULL;
+	if (defined && node->as.fn.statements.elements != NULL) {
+		fprintf(stderr, "Epic fail, %.*s is already defined.\n", node->as.fn.name.length, node->as.fn.name.p);
+		fail();
+	}
+	table_put_hashed(globals, name->name, name->hash, node);
 
-	node->as.fn.scope = create_scope();
+	node->as.fn.scope = create_scope(resolver);
+	if (node->as.fn.globals) {
+		resolver->globals = node->as.fn.scope;
+	}
 	if (node->as.fn.statements.elements != NULL) {
 		for (int i = 0; i < node->as.fn.parameters.length; i++) {
 			AstNode *parameter = LIST_GET(AstNode *, &node->as.fn.parameters, i);
-			parse_node(parameter);
+			parse_node(resolver, parameter);
 		}
 		
 		for (int i = 0; i < node->as.fn.statements.length; i++) {
-			parse_node(LIST_GET(AstNode *, &node->as.fn.statements, i));
+			parse_node(resolver, LIST_GET(AstNode *, &node->as.fn.statements, i));
 		}
 	}
-	current_scope = current_scope->prev;
+	resolver->current_scope = resolver->current_scope->prev;
 }
 
 static AstNode *get_declaration(AstNode *node) {
@@ -172,146 +193,170 @@ static AstNode *get_declaration(AstNode *node) {
 	return node->as.variable.declaration;
 }
 
-static void parse_function_call(AstNode *node) {
-	parse_node(node->as.call.variable);
+static void parse_function_call(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.call.variable);
 	node->as.call.function = get_declaration(node->as.call.variable);
 	for (int i = 0; i < node->as.call.arguments.length; i++) {
-		parse_node(LIST_GET(AstNode *, &node->as.call.arguments, i));
+		parse_node(resolver, LIST_GET(AstNode *, &node->as.call.arguments, i));
 	}
 }
 
-static void parse_if(AstNode *node) {
-	parse_node(node->as.if_.condition);
-	parse_node(node->as.if_.statement);
+static void parse_if(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.if_.condition);
+	parse_node(resolver, node->as.if_.statement);
 	if (node->as.if_.else_statement != NULL) {
-		parse_node(node->as.if_.else_statement);
+		parse_node(resolver, node->as.if_.else_statement);
 	}
 }
 
-static void parse_import(AstNode *node) {
-	char *import_path = resolve_module_path(module_dir, node->as.import.path);
+static void parse_import(Resolver *resolver, AstNode *node) {
+	char *import_path = resolve_module_path(resolver->module_dir, node->as.import.path);
 	char *identifier = path_to_name(import_path);
-	AstNode *file_node = table_get(modules, STRING(import_path));
+	AstNode *file_node = table_get(&resolver->compilation->graph.imports, STRING(import_path));
 	assert(file_node != NULL);
 	node->as.import.file_node = file_node;
-	table_put(current_scope->locals, STRING(identifier), file_node);
+	// The name is interned, so the scope doesn't own its key
+	Symbol *name = symbol_intern(&resolver->compilation->symbols, STRING(identifier));
+	table_put_hashed(resolver->current_scope->locals, name->name, name->hash, file_node);
+	free(identifier);
+	free(import_path);
 }
 
-static void parse_item_access(AstNode *node) {
-	parse_node(node->as.item_access.index);
-	parse_node(node->as.item_access.indexable);
+static void parse_item_access(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.item_access.index);
+	parse_node(resolver, node->as.item_access.indexable);
 }
 
-static void parse_match(AstNode *node) {
-	parse_node(node->as.match.matcher);
+static void parse_match(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.match.matcher);
 	for (int i = 0; i < node->as.match.branches.length; i++) {
 		MatchBranch branch = LIST_GET(MatchBranch, &node->as.match.branches, i);
 		// TODO: new scope to not clash
-		table_put(current_scope->locals, branch.identifier->as.variable.name, branch.identifier);
-		parse_node(branch.identifier);
-		parse_node(branch.expression);
+		Symbol *name = branch.identifier->as.variable.symbol;
+		table_put_hashed(resolver->current_scope->locals, name->name, name->hash, branch.identifier);
+		parse_node(resolver, branch.identifier);
+		parse_node(resolver, branch.expression);
 	}
 }
 
-static void parse_number(AstNode *node) {}
+static void parse_number(Resolver *resolver, AstNode *node) {}
 
-static void parse_operator(AstNode *node) {
-	parse_node(node->as.operator_.left);
-	parse_node(node->as.operator_.right);
+static void parse_operator(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.operator_.left);
+	parse_node(resolver, node->as.operator_.right);
 }
 
-static void parse_parameter(AstNode *node) {
-	table_put(current_scope->locals, node->as.parameter.name, node);
+static void parse_parameter(Resolver *resolver, AstNode *node) {
+	Symbol *name = node->as.parameter.symbol;
+	table_put_hashed(resolver->current_scope->locals, name->name, name->hash, node);
 }
 
-static void parse_return(AstNode *node) {
-	parse_node(node->as.return_.expression);
+static void parse_return(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.return_.expression);
 }
 
-static void parse_string(AstNode *node) {}
+static void parse_string(Resolver *resolver, AstNode *node) {}
 
-static void parse_variable(AstNode *node) {
-	AstNode *declaration = lookup_identifier(node->as.variable.name);
-	DEFINE_CSTRING(variable, node->as.variable.name);
-	assert(declaration != NULL);
+static void parse_variable(Resolver *resolver, AstNode *node) {
+	AstNode *declaration = lookup_identifier(resolver, node->as.variable.symbol);
+	if (declaration == NULL) {
+		fprintf(stderr, "Epic fail, unknown identifier %s.\n", node->as.variable.symbol->name.p);
+		fail();
+	}
 	node->as.variable.declaration = declaration;
 }
 
-static void parse_while(AstNode *node) {
-	parse_node(node->as.while_.condition);
-	parse_node(node->as.while_.statement);
+static void parse_while(Resolver *resolver, AstNode *node) {
+	parse_node(resolver, node->as.while_.condition);
+	parse_node(resolver, node->as.while_.statement);
 }
 
-static void parse_node(AstNode *node) {
+static void parse_node(Resolver *resolver, AstNode *node) {
 	switch (node->type) {
 		case AST_ACCESSOR:
-			parse_accessor(node);
+			parse_accessor(resolver, node);
 			break;
 		case AST_ARRAY:
-			parse_array(node);
+			parse_array(resolver, node);
 			break;
 		case AST_ASSIGNMENT:
-			parse_assignment(node);
+			parse_assignment(resolver, node);
 			break;
 		case AST_BLOCK:
-			parse_block(node);
+			parse_block(resolver, node);
 			break;
 		case AST_BOOL:
 			break;
 		case AST_FILE:
-			parse_file_node(node);
+			parse_file_node(resolver, node);
 			break;
 		case AST_FUNCTION:
-			parse_function(node);
+			parse_function(resolver, node);
 			break;
 		case AST_FUNCTION_CALL:
-			parse_function_call(node);
+			parse_function_call(resolver, node);
 			break;
 		case AST_IF:
-			parse_if(node);
+			parse_if(resolver, node);
 			break;
 		case AST_IMPORT:
-			parse_import(node);
+			parse_import(resolver, node);
 			break;
 		case AST_ITEM_ACCESS:
-			parse_item_access(node);
+			parse_item_access(resolver, node);
 			break;
 		case AST_MATCH:
-			parse_match(node);
+			parse_match(resolver, node);
 			break;
 		case AST_NUMBER:
-			parse_number(node);
+			parse_number(resolver, node);
 			break;
 		case AST_OPERATOR:
-			parse_operator(node);
+			parse_operator(resolver, node);
 			break;
 		case AST_PARAMETER:
-			parse_parameter(node);
+			parse_parameter(resolver, node);
 			break;
 		case AST_RETURN:
-			parse_return(node);
+			parse_return(resolver, node);
 			break;
 		case AST_STRING:
-			parse_string(node);
+			parse_string(resolver, node);
 			break;
 		case AST_VARIABLE:
-			parse_variable(node);
+			parse_variable(resolver, node);
 			break;
 		case AST_WHILE:
-			parse_while(node);
+			parse_while(resolver, node);
 			break;
     }
 }
 
-void resolve(AstNode *node, char *dir) {
-	module_dir = dir;
-	parse_node(node);
+void resolve(Compilation *compilation, AstNode *node, char *dir) {
+	Resolver resolver;
+	resolver.compilation = compilation;
+	resolver.module_symbol = NULL;
+	resolver.main_symbol = symbol_intern(&compilation->symbols, STRING("main"));
+	resolver.module_dir = dir;
+	resolver.current_scope = &compilation->global_scope;
+	resolver.globals = NULL;
+	parse_node(&resolver, node);
+}
+
+// Scopes are in the arena, the slots and entries of their tables aren't
+void resolver_free(Compilation *compilation) {
+	for (int i = 0; i < compilation->scopes.length; i++) {
+		table_free(LIST_GET(Scope *, &compilation->scopes, i)->locals);
+	}
+	free(compilation->scopes.elements);
+	table_free(compilation->global_scope.locals);
 }
 
-void resolver_initialize(Table *modules_) {
-	modules = modules_;
-	global_scope.prev = NULL;
-	global_scope.locals = malloc(sizeof(Table));
-	current_scope = &global_scope;
-    table_init(global_scope.locals);
+void resolver_initialize(Compilation *compilation) {
+	list_init(&compilation->scopes, sizeof(Scope *));
+	Scope *global_scope = &compilation->global_scope;
+	global_scope->prev = NULL;
+	global_scope->locals = arena_alloc(&compilation->arena, sizeof(Table));
+	memory_count(MEMORY_SCOPES, sizeof(Table));
+    table_init(global_scope->locals);
 }
@@ -1,11 +1,13 @@
 #ifndef PENQUIN_RESOLVER_H
 #define PENQUIN_RESOLVER_H
 
+#include "arena.h"
 #include "parser.h"
 #include "table.h"
 
 char *resolve_module_path(char *dir, String module_name);
-void resolve(AstNode *node, char *dir);
-void resolver_initialize(Table *modules);
+void resolve(Compilation *compilation, AstNode *node, char *dir);
+void resolver_free(Compilation *compilation);
+void resolver_initialize(Compilation *compilation);
 
 #endif
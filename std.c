@@ -0,0 +1,30 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <llvm-c/BitReader.h>
+#include "std.h"
+
+// Ends with a module without a path, empty when building the compiler that
+// compiles std
+extern StdModule std_modules[];
+
+StdModule *std_module(char *path) {
+	for (StdModule *module = std_modules; module->path != NULL; module++) {
+		if (strcmp(module->path, path) == 0) {
+			return module;
+		}
+	}
+	return NULL;
+}
+
+LLVMModuleRef std_load(StdModule *module, LLVMContextRef context) {
+	LLVMModuleRef llvm_module;
+	LLVMMemoryBufferRef buffer = LLVMCreateMemoryBufferWithMemoryRange(module->bitcode, module->bitcode_end - module->bitcode, module->path, false);
+	if (LLVMParseBitcodeInContext2(context, buffer, &llvm_module)) {
+		fprintf(stderr, "Epic fail: embedded bitcode of %s is broken\n", module->path);
+		exit(1);
+	}
+	LLVMDisposeMemoryBuffer(buffer);
+	return llvm_module;
+}
@@ -0,0 +1,21 @@
+#ifndef PENQUIN_STD_H
+#define PENQUIN_STD_H
+
+#include <stddef.h>
+#include <llvm-c/Types.h>
+
+// The std modules are compiled when penquin is built, their bitcode and
+// interfaces are embedded in the binary by the generated std_modules.c
+typedef struct {
+	char *path; // as imported, like std:core
+	char *interface;
+	char *interface_end;
+	char *bitcode;
+	char *bitcode_end;
+} StdModule;
+
+// Parses the bitcode of module into context
+LLVMModuleRef std_load(StdModule *module, LLVMContextRef context);
+StdModule    *std_module(char *path);
+
+#endif
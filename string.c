@@ -1,10 +1,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include "common.h"
+#include "memory.h"
 
 char *cstring_concat_String(char *c, String s) {
 	int clen = strlen(c);
 	char *res = malloc(clen + s.length + 1);
+	memory_count(MEMORY_STRINGS, clen + s.length + 1);
 	strncpy(res, c, clen);
 	strncpy(res + clen, s.p, s.length);
 	res[clen + s.length] = '\0';
@@ -12,7 +14,8 @@ char *cstring_concat_String(char *c, String s) {
 }
 
 char *cstring_duplicate(char *c) {
-	char *res = malloc(sizeof(c));
+	char *res = malloc(strlen(c) + 1);
+	memory_count(MEMORY_STRINGS, strlen(c) + 1);
 	strcpy(res, c);
 	return res;
 }
@@ -37,6 +40,7 @@ String String_concat_cstring(String s, char *c) {
 	String res;
 	res.length = s.length + clen;
 	res.p = malloc(res.length);
+	memory_count(MEMORY_STRINGS, res.length);
 	strncpy(res.p, s.p, s.length);
 	strncpy(res.p + s.length, c, clen);
 	return res;
@@ -56,6 +60,7 @@ bool String_starts_with(String s, char *c) {
 
 char *String_to_cstring(String s) {
 	char *c = (char *)malloc((s.length + 1) * sizeof(char *));
+	memory_count(MEMORY_STRINGS, (s.length + 1) * sizeof(char *));
 	strncpy(c, s.p, s.length + 1);
 	c[s.length] = '\0';
 	return c;
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+#include "symbol.h"
+#include "table.h"
+
+static Symbol *create_symbol(Symbols *symbols, String name, unsigned int hash) {
+	Symbol *symbol = arena_alloc(&symbols->arena, sizeof(Symbol));
+	char *p = arena_alloc(&symbols->arena, name.length + 1);
+	memory_count(MEMORY_SYMBOLS, sizeof(Symbol) + name.length + 1);
+	memcpy(p, name.p, name.length);
+	p[name.length] = '\0';
+	symbol->name.p = p;
+	symbol->name.length = name.length;
+	symbol->hash = hash;
+	table_put_hashed(&symbols->symbols, symbol->name, hash, symbol);
+	return symbol;
+}
+
+static Symbol *intern(Symbols *symbols, String name) {
+	unsigned int hash = table_hash(name);
+	Symbol *symbol = table_get_hashed(&symbols->symbols, name, hash);
+	if (symbol == NULL) {
+		symbol = create_symbol(symbols, name, hash);
+	}
+	return symbol;
+}
+
+Symbol *symbol_intern(Symbols *symbols, String name) {
+	pthread_mutex_lock(&symbols->lock);
+	Symbol *symbol = intern(symbols, name);
+	pthread_mutex_unlock(&symbols->lock);
+	return symbol;
+}
+
+static inline unsigned int hash_pair(Symbol *module, Symbol *name) {
+	uintptr_t h = (uintptr_t)module * 31 + (uintptr_t)name;
+	h ^= h >> 17;
+	h *= 0xed5ad4bbu;
+	h ^= h >> 11;
+	return (unsigned int)h;
+}
+
+static void grow_qualified(Symbols *symbols) {
+	int capacity = symbols->qualified_capacity == 0 ? 64 : symbols->qualified_capacity * 2;
+	QualifiedEntry *entries = calloc(capacity, sizeof(QualifiedEntry));
+	memory_count(MEMORY_SYMBOLS, capacity * sizeof(QualifiedEntry));
+	if (entries == NULL) {
+		fprintf(stderr, "Unable to allocate memory for symbols\n");
+		exit(1);
+	}
+	for (int i = 0; i < symbols->qualified_capacity; i++) {
+		QualifiedEntry entry = symbols->qualified[i];
+		if (entry.qualified == NULL) {
+			continue;
+		}
+		int j = hash_pair(entry.module, entry.name) & (capacity - 1);
+		while (entries[j].qualified != NULL) {
+			j = (j + 1) & (capacity - 1);
+		}
+		entries[j] = entry;
+	}
+	free(symbols->qualified);
+	symbols->qualified = entries;
+	symbols->qualified_capacity = capacity;
+}
+
+Symbol *symbol_qualify(Symbols *symbols, Symbol *module, Symbol *name) {
+	pthread_mutex_lock(&symbols->lock);
+	if (2 * (symbols->qualified_length + 1) > symbols->qualified_capacity) {
+		grow_qualified(symbols);
+	}
+
+	int i = hash_pair(module, name) & (symbols->qualified_capacity - 1);
+	while (symbols->qualified[i].qualified != NULL) {
+		if (symbols->qualified[i].module == module && symbols->qualified[i].name == name) {
+			pthread_mutex_unlock(&symbols->lock);
+			return symbols->qualified[i].qualified;
+		}
+		i = (i + 1) & (symbols->qualified_capacity - 1);
+	}
+
+	int length = module->name.length + 1 + name->name.length;
+	char buffer[length];
+	memcpy(buffer, module->name.p, module->name.length);
+	buffer[module->name.length] = '@';
+	memcpy(buffer + module->name.length + 1, name->name.p, name->name.length);
+
+	symbols->qualified[i].module = module;
+	symbols->qualified[i].name = name;
+	symbols->qualified[i].qualified = intern(symbols, (String) { .p = buffer, .length = length });
+	symbols->qualified_length++;
+	Symbol *symbol = symbols->qualified[i].qualified;
+	pthread_mutex_unlock(&symbols->lock);
+	return symbol;
+}
+
+void symbol_free(Symbols *symbols) {
+	arena_free(&symbols->arena);
+	table_free(&symbols->symbols);
+	free(symbols->qualified);
+	pthread_mutex_destroy(&symbols->lock);
+}
+
+void symbol_initialize(Symbols *symbols, bool huge_pages) {
+	pthread_mutex_init(&symbols->lock, NULL);
+	arena_init(&symbols->arena, huge_pages);
+	table_init(&symbols->symbols);
+	symbols->qualified = NULL;
+	symbols->qualified_length = 0;
+	symbols->qualified_capacity = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef PENQUIN_SYMBOL_H
+#define PENQUIN_SYMBOL_H
+
+#include <pthread.h>
+#include "arena.h"
+#include "common.h"
+#include "table.h"
+
+// Interned identifier, equal names share one Symbol. The name is NUL
+// terminated and the hash matches table_hash() so symbols can be looked up
+// in tables without hashing the name again.
+typedef struct Symbol {
+	String name;
+	unsigned int hash;
+} Symbol;
+
+typedef struct {
+	Symbol *module;
+	Symbol *name;
+	Symbol *qualified;
+} QualifiedEntry;
+
+// Symbol store of one compilation, interning is locked since files are
+// parsed on several threads
+typedef struct {
+	pthread_mutex_t lock;
+	Arena arena;
+	Table symbols;
+	// Module qualified names ("path@name") keyed by the pair of symbols so
+	// that resolving a reference doesn't need to build the mangled string
+	QualifiedEntry *qualified;
+	int qualified_length;
+	int qualified_capacity;
+} Symbols;
+
+void    symbol_free(Symbols *symbols);
+void    symbol_initialize(Symbols *symbols, bool huge_pages);
+Symbol *symbol_intern(Symbols *symbols, String name);
+Symbol *symbol_qualify(Symbols *symbols, Symbol *module, Symbol *name);
+
+#endif
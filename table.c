@@ -1,88 +1,190 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include "memory.h"
 #include "table.h"
 
-static int hash(String key, int max) {
+#define TABLE_MIN_CAPACITY 8
+#define TABLE_MAX_LENGTH(capacity) ((capacity) - (capacity) / 4)
+#define TABLE_EMPTY -1
+
+unsigned int table_hash(String key) {
 	unsigned int hash = 2166136261u;
 	for (int i = 0; i < key.length; i++) {
 		hash = hash * 16777619u;
 		hash = hash ^ key.p[i];
 	}
-    return hash % max;
+    return hash;
+}
+
+static inline bool key_equals(String a, String b) {
+	return a.length == b.length && (a.p == b.p || strncmp(a.p, b.p, a.length) == 0);
+}
+
+static inline int probe_distance(Table *table, unsigned int hash, int i) {
+	return (i - (int)(hash & (table->capacity - 1))) & (table->capacity - 1);
+}
+
+static void *allocate(size_t size) {
+	void *p = malloc(size);
+	if (p == NULL) {
+		fprintf(stderr, "Unable to allocate memory for table\n");
+		exit(1);
+	}
+	memory_count(MEMORY_TABLES, size);
+	return p;
+}
+
+static void insert_slot(Table *table, TableSlot slot) {
+	int mask = table->capacity - 1;
+	int i = slot.hash & mask;
+	int distance = 0;
+	while (table->slots[i].index != TABLE_EMPTY) {
+		int existing_distance = probe_distance(table, table->slots[i].hash, i);
+		if (existing_distance < distance) {
+			TableSlot displaced = table->slots[i];
+			table->slots[i] = slot;
+			slot = displaced;
+			distance = existing_distance;
+		}
+		i = (i + 1) & mask;
+		distance++;
+	}
+	table->slots[i] = slot;
+}
+
+// Rebuilds the slots with the given capacity, dropping removed entries
+static void rebuild(Table *table, int capacity) {
+	TableEntry *entries = allocate(sizeof(TableEntry) * TABLE_MAX_LENGTH(capacity));
+	int length = 0;
+	for (int i = 0; i < table->used; i++) {
+		if (table->entries[i].key.p != NULL) {
+			entries[length++] = table->entries[i];
+		}
+	}
+	free(table->entries);
+	free(table->slots);
+
+	table->entries = entries;
+	table->slots = allocate(sizeof(TableSlot) * capacity);
+	table->capacity = capacity;
+	table->used = length;
+	table->length = length;
+
+	for (int i = 0; i < capacity; i++) {
+		table->slots[i].index = TABLE_EMPTY;
+	}
+	for (int i = 0; i < length; i++) {
+		insert_slot(table, (TableSlot) { .hash = entries[i].hash, .index = i });
+	}
+}
+
+static int find_slot(Table *table, String key, unsigned int hash) {
+	if (table->length == 0) {
+		return -1;
+	}
+	int mask = table->capacity - 1;
+	int i = hash & mask;
+	for (int distance = 0; ; distance++) {
+		TableSlot slot = table->slots[i];
+		if (slot.index == TABLE_EMPTY || probe_distance(table, slot.hash, i) < distance) {
+			return -1;
+		}
+		if (slot.hash == hash && key_equals(table->entries[slot.index].key, key)) {
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
 }
 
 void table_init(Table *table) {
+    table->slots = NULL;
     table->entries = NULL;
     table->length = 0;
     table->capacity = 0;
+    table->used = 0;
 }
 
-void static table_put_inner(Table *table, String key, void *value) {
-    int i = hash(key, table->capacity);
-	while (table->entries[i].key.p != NULL && String_cmp(key, table->entries[i].key) != 0) {
-		i = (i + 1) % table->capacity;
+void table_free(Table *table) {
+	free(table->slots);
+	free(table->entries);
+	table_init(table);
+}
+
+void table_put_hashed(Table *table, String key, unsigned int hash, void *value) {
+	int i = find_slot(table, key, hash);
+	if (i != -1) {
+		table->entries[table->slots[i].index].element = value;
+		return;
 	}
 
-	if (table->entries[i].key.p == NULL) {
-		table->length++;
+	if (table->used + 1 > TABLE_MAX_LENGTH(table->capacity)) {
+		int capacity = table->capacity == 0 ? TABLE_MIN_CAPACITY : table->capacity;
+		// Only grow when the holes left by removals don't make enough room
+		if (table->length + 1 > TABLE_MAX_LENGTH(capacity) / 2) {
+			capacity *= 2;
+		}
+		rebuild(table, capacity);
 	}
-	
-    table->entries[i].key = key;
-    table->entries[i].element = value;
+
+	int index = table->used++;
+	table->entries[index] = (TableEntry) { .key = key, .hash = hash, .element = value };
+	table->length++;
+	insert_slot(table, (TableSlot) { .hash = hash, .index = index });
 }
 
 void table_put(Table *table, String key, void *value) {
-    if (table->length + 1 > table->capacity) {
-        int capacity = table->capacity == 0 ? 8 : table->capacity * 2;
-        TableEntry *entries = (TableEntry *)calloc(capacity, sizeof(TableEntry));
-        if (entries == NULL) {
-            fprintf(stderr, "Unable to allocate memory for table\n");
-            exit(1);
-        }
-
-		int old_capacity = table->capacity;
-		TableEntry *old_entries = table->entries;
-
-        table->capacity = capacity;
-        table->entries = entries;
-
-		if (old_capacity != 0) {
-			for (int i = 0; i < old_capacity; i++) {
-				TableEntry old_entry = old_entries[i];
-				table_put_inner(table, old_entry.key, old_entry.element);
-			}
-			free(old_entries);
-		}
-    }
+	table_put_hashed(table, key, table_hash(key), value);
+}
 
-	table_put_inner(table, key, value);
+void *table_get_hashed(Table *table, String key, unsigned int hash) {
+	int i = find_slot(table, key, hash);
+	if (i == -1) {
+		return NULL;
+	}
+	return table->entries[table->slots[i].index].element;
 }
 
 void *table_get(Table *table, String key) {
-    if (key.p == NULL || table->capacity == 0) {
-        return NULL;
-    }
-    int i = hash(key, table->capacity);
-	int start_i = i;
-	while (table->entries[i].key.p == NULL || String_cmp(table->entries[i].key, key) != 0) {
-		i = (i + 1) % table->capacity;
-		if (i == start_i) return NULL;
+	if (key.p == NULL) {
+		return NULL;
 	}
-    TableEntry entry = table->entries[i];
-    return entry.element;
+	return table_get_hashed(table, key, table_hash(key));
 }
 
-void **table_get_all(Table *table) {
-	if (table->length == 0) {
+void *table_remove(Table *table, String key) {
+	int i = find_slot(table, key, table_hash(key));
+	if (i == -1) {
 		return NULL;
 	}
-	void **all = malloc(sizeof(void *) * table->length);
-	for (int i = 0, n = 0; i < table->capacity; i++) {
-		if (table->entries[i].key.p != NULL) {
-			all[n++] = table->entries[i].element;
-		}
+
+	TableEntry *entry = &table->entries[table->slots[i].index];
+	void *element = entry->element;
+	entry->key.p = NULL;
+	entry->element = NULL;
+	table->length--;
+
+	// Backward shift deletion keeps probe sequences intact without tombstones
+	int mask = table->capacity - 1;
+	int next = (i + 1) & mask;
+	while (table->slots[next].index != TABLE_EMPTY &&
+		   probe_distance(table, table->slots[next].hash, next) > 0) {
+		table->slots[i] = table->slots[next];
+		i = next;
+		next = (next + 1) & mask;
 	}
-    return all;
+	table->slots[i].index = TABLE_EMPTY;
+	return element;
 }
 
+// Iterates the entries in insertion order, start with *i = 0
+bool table_next(Table *table, int *i, TableEntry **entry) {
+	while (*i < table->used) {
+		TableEntry *current = &table->entries[(*i)++];
+		if (current->key.p != NULL) {
+			*entry = current;
+			return true;
+		}
+	}
+	return false;
+}
@@ -6,18 +6,35 @@
 
 typedef struct {
     String key;
+    unsigned int hash;
     void *element;
 } TableEntry;
 
+typedef struct {
+    unsigned int hash;
+    int index;
+} TableSlot;
+
+// Open addressing hash map with Robin Hood probing over a power of two
+// number of slots, kept at most 3/4 full. Slots index into entries, which
+// are kept in insertion order; removed entries are left as holes until the
+// next rebuild.
 typedef struct {
     int length;
     int capacity;
+    int used;
+    TableSlot *slots;
     TableEntry *entries;
 } Table;
 
+unsigned int table_hash(String key);
 void table_init(Table *table);
+void table_free(Table *table);
 void table_put(Table *table, String key, void *value);
+void table_put_hashed(Table *table, String key, unsigned int hash, void *value);
 void *table_get(Table *table, String key);
-void **table_get_all(Table *table);
+void *table_get_hashed(Table *table, String key, unsigned int hash);
+void *table_remove(Table *table, String key);
+bool table_next(Table *table, int *i, TableEntry **entry);
 
 #endif
@@ -0,0 +1,157 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+#include "common.h"
+
+static double now(clockid_t clock) {
+	struct timespec time;
+	clock_gettime(clock, &time);
+	return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+// Threads are numbered in the order they first record a span
+static int thread_number() {
+	static atomic_int next_thread = 1;
+	static _Thread_local int thread = 0;
+	if (thread == 0) {
+		thread = atomic_fetch_add(&next_thread, 1);
+	}
+	return thread;
+}
+
+void timings_init(Timings *timings, bool enabled) {
+	timings->enabled = enabled;
+	pthread_mutex_init(&timings->lock, NULL);
+	timings->origin = now(CLOCK_MONOTONIC);
+	list_init(&timings->spans, sizeof(Span));
+}
+
+void timings_free(Timings *timings) {
+	for (int i = 0; i < timings->spans.length; i++) {
+		Span *span = &LIST_GET(Span, &timings->spans, i);
+		free(span->module);
+		free(span->function);
+	}
+	free(timings->spans.elements);
+	pthread_mutex_destroy(&timings->lock);
+}
+
+Timer timer_start(Timings *timings) {
+	Timer timer = { .wall = 0, .cpu = 0 };
+	if (timings->enabled) {
+		timer.wall = now(CLOCK_MONOTONIC);
+		timer.cpu = now(CLOCK_THREAD_CPUTIME_ID);
+	}
+	return timer;
+}
+
+void timer_stop(Timings *timings, Timer timer, char *phase, const char *module, const char *function) {
+	if (!timings->enabled) {
+		return;
+	}
+	Span span;
+	span.phase = phase;
+	span.module = module != NULL ? cstring_duplicate((char *)module) : NULL;
+	span.function = function != NULL ? cstring_duplicate((char *)function) : NULL;
+	span.thread = thread_number();
+	span.start = timer.wall - timings->origin;
+	span.wall = now(CLOCK_MONOTONIC) - timer.wall;
+	span.cpu = now(CLOCK_THREAD_CPUTIME_ID) - timer.cpu;
+
+	pthread_mutex_lock(&timings->lock);
+	list_add(&timings->spans, &span);
+	pthread_mutex_unlock(&timings->lock);
+}
+
+typedef struct {
+	char *phase;
+	char *module;
+	int count;
+	double wall;
+	double cpu;
+} Total;
+
+// Totals are kept in the order their first span was recorded
+static void add_total(List *totals, Span *span, bool by_module) {
+	char *module = by_module ? span->module : NULL;
+	for (int i = 0; i < totals->length; i++) {
+		Total *total = &LIST_GET(Total, totals, i);
+		bool same_module = module == NULL ? total->module == NULL : total->module != NULL && strcmp(total->module, module) == 0;
+		if (strcmp(total->phase, span->phase) == 0 && same_module) {
+			total->count++;
+			total->wall += span->wall;
+			total->cpu += span->cpu;
+			return;
+		}
+	}
+	Total total = { .phase = span->phase, .module = module, .count = 1, .wall = span->wall, .cpu = span->cpu };
+	list_add(totals, &total);
+}
+
+void timings_report(Timings *timings, FILE *file) {
+	List phases;
+	List modules;
+	list_init(&phases, sizeof(Total));
+	list_init(&modules, sizeof(Total));
+	for (int i = 0; i < timings->spans.length; i++) {
+		Span *span = &LIST_GET(Span, &timings->spans, i);
+		// Functions of a module are inside its span, only JIT lookups have
+		// functions on their own
+		if (span->module != NULL && span->function != NULL) {
+			continue;
+		}
+		add_total(&phases, span, false);
+		if (span->module != NULL) {
+			add_total(&modules, span, true);
+		}
+	}
+
+	fprintf(file, "%-16s %8s %12s %12s\n", "phase", "count", "wall ms", "cpu ms");
+	for (int i = 0; i < phases.length; i++) {
+		Total *total = &LIST_GET(Total, &phases, i);
+		fprintf(file, "%-16s %8d %12.3f %12.3f\n", total->phase, total->count, total->wall / 1e3, total->cpu / 1e3);
+	}
+	fprintf(file, "\n%-16s %12s %12s  %s\n", "phase", "wall ms", "cpu ms", "module");
+	for (int i = 0; i < modules.length; i++) {
+		Total *total = &LIST_GET(Total, &modules, i);
+		fprintf(file, "%-16s %12.3f %12.3f  %s\n", total->phase, total->wall / 1e3, total->cpu / 1e3, total->module);
+	}
+	free(phases.elements);
+	free(modules.elements);
+}
+
+static void write_json_string(FILE *file, char *string) {
+	fputc('"', file);
+	for (char *c = string; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', file);
+		}
+		fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+void timings_write_trace(Timings *timings, char *path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Epic fail: unable to write trace %s\n", path);
+		exit(1);
+	}
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (int i = 0; i < timings->spans.length; i++) {
+		Span *span = &LIST_GET(Span, &timings->spans, i);
+		fprintf(file, "%s{\"name\":", i == 0 ? "" : ",\n");
+		write_json_string(file, span->function != NULL ? span->function : span->phase);
+		fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu_us\":%.3f",
+				span->phase, span->thread, span->start, span->wall, span->cpu);
+		if (span->module != NULL) {
+			fprintf(file, ",\"module\":");
+			write_json_string(file, span->module);
+		}
+		fprintf(file, "}}");
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+}
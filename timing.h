@@ -0,0 +1,43 @@
+#ifndef PENQUIN_TIMING_H
+#define PENQUIN_TIMING_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "list.h"
+
+// Wall and CPU time of the phases of a compilation, spans are recorded by
+// whichever thread runs the phase
+typedef struct {
+	char *phase;
+	char *module;   // owned, NULL for phases of the whole compilation
+	char *function; // owned, NULL for spans of modules
+	int thread;
+	double start;   // microseconds since the compilation started
+	double wall;
+	double cpu;
+} Span;
+
+typedef struct {
+	bool enabled;
+	pthread_mutex_t lock;
+	double origin;
+	List spans; // Span
+} Timings;
+
+// Returned by timer_start and given back to timer_stop
+typedef struct {
+	double wall;
+	double cpu;
+} Timer;
+
+void  timer_stop(Timings *timings, Timer timer, char *phase, const char *module, const char *function);
+Timer timer_start(Timings *timings);
+void  timings_free(Timings *timings);
+void  timings_init(Timings *timings, bool enabled);
+// Totals per phase and per module
+void  timings_report(Timings *timings, FILE *file);
+// Chrome trace event format, for chrome://tracing or Perfetto
+void  timings_write_trace(Timings *timings, char *path);
+
+#endif
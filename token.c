@@ -1,24 +1,29 @@
 #include <stdbool.h>
-#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "token.h"
 
 #define CASE_TOKEN(token) case TOKEN_##token: return #token
 
+#define CHAR_SPACE 1
+#define CHAR_ALPHA 2
+#define CHAR_DIGIT 4
 
-typedef struct {
-    char *source;
-    int start;
-    int current;
-    int line;
-    int col;
-} Scanner;
+// Same classes as isspace/isalpha/isdigit in the C locale, '_' counts as alpha
+static const unsigned char char_class[256] = {
+	['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE, ['\v'] = CHAR_SPACE,
+	['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE, [' '] = CHAR_SPACE,
+	['0' ... '9'] = CHAR_DIGIT,
+	['A' ... 'Z'] = CHAR_ALPHA,
+	['a' ... 'z'] = CHAR_ALPHA,
+	['_'] = CHAR_ALPHA,
+};
 
 
-Scanner scanner;
-List *list;
-static TokenType prev_token_type;
-
 
 const char *token_type_to_string(TokenType type) {
     switch (type) {
@@ -68,88 +73,172 @@ const char *token_type_to_string(TokenType type) {
     }
 }
 
-static void skip_whitespace() {
-    char c;
-    while (isspace(c = scanner.source[scanner.current])) {
-        if (c == '\n') {
-            scanner.line++;
-            scanner.col = 0;
-        }
-        scanner.col++;
-        scanner.current++;
-    }
+static bool is_space(char c) {
+	return char_class[(unsigned char)c] & CHAR_SPACE;
 }
 
-static void scan_identifier() {
-    char c;
-    while (isalnum(c = scanner.source[scanner.current]) || c == '_') {
-        scanner.current++;
-    }
+static bool is_identifier(char c) {
+	return char_class[(unsigned char)c] & (CHAR_ALPHA | CHAR_DIGIT);
 }
 
-static void scan_number() {
-    while (isdigit(scanner.source[scanner.current])) {
-        scanner.current++;
+static bool is_digit(char c) {
+	return char_class[(unsigned char)c] & CHAR_DIGIT;
+}
+
+#ifdef __SSE2__
+// Masks of the bytes in a 16 byte block belonging to a class. Bytes above
+// 0x7f never match, which agrees with the class table.
+static inline __m128i in_range(__m128i x, char low, char count) {
+	__m128i offset = _mm_sub_epi8(x, _mm_set1_epi8(low));
+	return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(count - 1)), offset);
+}
+
+static inline int space_mask(__m128i x) {
+	__m128i space = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+	return _mm_movemask_epi8(_mm_or_si128(space, in_range(x, '\t', 5)));
+}
+
+static inline int identifier_mask(__m128i x) {
+	__m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+	__m128i alpha = in_range(lower, 'a', 26);
+	__m128i digit = in_range(x, '0', 10);
+	__m128i underscore = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+	return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), underscore));
+}
+
+static inline int string_body_mask(__m128i x) {
+	__m128i quote = _mm_cmpeq_epi8(x, _mm_set1_epi8('"'));
+	__m128i end = _mm_cmpeq_epi8(x, _mm_setzero_si128());
+	return ~_mm_movemask_epi8(_mm_or_si128(quote, end)) & 0xffff;
+}
+
+// Skips the run of bytes matching MASK starting at P, 16 bytes at a time.
+// Loads are aligned so they never cross into a page past the terminating
+// '\0', which matches no class.
+#define SKIP_RUN(p, MASK) do {\
+	const char *block = (const char *)((uintptr_t)(p) & ~(uintptr_t)15);\
+	int skip = (p) - block;\
+	for (;;) {\
+		__m128i x = _mm_load_si128((const __m128i *)block);\
+		unsigned int run = ~(MASK(x) | ((1u << skip) - 1)) & 0xffff;\
+		if (run != 0) {\
+			(p) = block + __builtin_ctz(run);\
+			break;\
+		}\
+		block += 16;\
+		skip = 0;\
+	}\
+} while (0)
+#endif
+
+// Most runs are a few bytes long, the vector loop only pays off for long
+// ones such as indentation and long names
+#define SHORT_RUN 8
+
+static const char *skip_whitespace(const char *p) {
+	const char *start = p;
+	while (is_space(*p) && p - start < SHORT_RUN) {
+		p++;
+	}
+#ifdef __SSE2__
+	if (is_space(*p)) {
+		SKIP_RUN(p, space_mask);
+	}
+#else
+	while (is_space(*p)) {
+		p++;
+	}
+#endif
+	return p;
+}
+
+static const char *scan_identifier(const char *p) {
+	const char *start = p;
+	while (is_identifier(*p) && p - start < SHORT_RUN) {
+		p++;
+	}
+#ifdef __SSE2__
+	if (is_identifier(*p)) {
+		SKIP_RUN(p, identifier_mask);
+	}
+#else
+	while (is_identifier(*p)) {
+		p++;
+	}
+#endif
+	return p;
+}
+
+static const char *scan_number(const char *p) {
+    while (is_digit(*p)) {
+        p++;
     }
-    if (scanner.source[scanner.current] == '.') {
-        scanner.current++;
-        while (isdigit(scanner.source[scanner.current])) {
-            scanner.current++;
+    if (*p == '.') {
+        p++;
+        while (is_digit(*p)) {
+            p++;
         }
     }
+	return p;
 }
 
-static bool scan_string() {
-    char c;
-    while ((c = scanner.source[scanner.current]) != '\0' && c != '"') {
-        scanner.current++;
-    }
-    if (c == '"') {
-        scanner.current++;
-        return true;
-    }
-    return false;
+// Returns the position after the closing quote, or of the '\0' if there is none
+static const char *scan_string(const char *p) {
+#ifdef __SSE2__
+	SKIP_RUN(p, string_body_mask);
+#else
+	while (*p != '\0' && *p != '"') {
+		p++;
+	}
+#endif
+    return *p == '"' ? p + 1 : p;
+}
+
+static TokenType identifier_type(const char *s, int length) {
+	switch (length) {
+		case 2:
+			if (s[0] == 'i' && s[1] == 'f') return TOKEN_IF;
+			break;
+		case 3:
+			if (memcmp(s, "fun", 3) == 0) return TOKEN_FUN;
+			break;
+		case 4:
+			if (s[0] == 'e' && memcmp(s, "else", 4) == 0) return TOKEN_ELSE;
+			if (s[0] == 't' && memcmp(s, "true", 4) == 0) return TOKEN_TRUE;
+			break;
+		case 5:
+			switch (s[0]) {
+				case 'f': if (memcmp(s, "false", 5) == 0) return TOKEN_FALSE; break;
+				case 'm': if (memcmp(s, "match", 5) == 0) return TOKEN_MATCH; break;
+				case 'w': if (memcmp(s, "while", 5) == 0) return TOKEN_WHILE; break;
+			}
+			break;
+		case 6:
+			switch (s[0]) {
+				case 'e': if (memcmp(s, "extern", 6) == 0) return TOKEN_EXTERN; break;
+				case 'i': if (memcmp(s, "import", 6) == 0) return TOKEN_IMPORT; break;
+				case 'r': if (memcmp(s, "return", 6) == 0) return TOKEN_RETURN; break;
+			}
+			break;
+	}
+	return TOKEN_IDENTIFIER;
 }
 
 
-static void scan_token() {
-    skip_whitespace();
-    int start = scanner.current++;
-    char c = scanner.source[start];
+Token token_next(TokenStream *stream) {
+	const char *p = skip_whitespace(stream->source + stream->current);
+	const char *raw = p++;
+    char c = *raw;
 
     Token token;
-    token.line = scanner.line;
-    token.col = scanner.col++;
-    token.raw = scanner.source + start;
+    token.offset = raw - stream->source;
 
-	if (isalpha(c) || c == '_') {
-		scan_identifier();
-		int len = scanner.current - start;
-		if (len == 2 && strncmp(token.raw, "if", 2) == 0) {
-			token.type = TOKEN_IF;
-		} else if (len == 3 && strncmp(token.raw, "fun", 3) == 0) {
-			token.type = TOKEN_FUN;
-		} else if (len == 4 && strncmp(token.raw, "else", 4) == 0) {
-			token.type = TOKEN_ELSE;
-		} else if (len == 4 && strncmp(token.raw, "true", 4) == 0) {
-			token.type = TOKEN_TRUE;
-		} else if (len == 5 && strncmp(token.raw, "false", 5) == 0) {
-			token.type = TOKEN_FALSE;
-		} else if (len == 5 && strncmp(token.raw, "match", 5) == 0) {
-			token.type = TOKEN_MATCH;
-		} else if (len == 5 && strncmp(token.raw, "while", 5) == 0) {
-			token.type = TOKEN_WHILE;
-		} else if (len == 6 && strncmp(token.raw, "extern", 6) == 0) {
-			token.type = TOKEN_EXTERN;
-		} else if (len == 6 && strncmp(token.raw, "import", 6) == 0) {
-			token.type = TOKEN_IMPORT;
-		} else if (len == 6 && strncmp(token.raw, "return", 6) == 0) {
-			token.type = TOKEN_RETURN;
-		} else {
-			token.type = TOKEN_IDENTIFIER;
-		}
-	} else if (isdigit(c) || (c == '-' && isdigit(token.raw[1]) && prev_token_type != TOKEN_NUMBER)) {
-		scan_number();
+	unsigned char class = char_class[(unsigned char)c];
+	if (class & CHAR_ALPHA) {
+		p = scan_identifier(p);
+		token.type = identifier_type(raw, p - raw);
+	} else if ((class & CHAR_DIGIT) || (c == '-' && is_digit(raw[1]) && stream->prev_type != TOKEN_NUMBER)) {
+		p = scan_number(p);
 		token.type = TOKEN_NUMBER;
 	} else switch (c) {
         case '{':
@@ -171,8 +260,8 @@ static void scan_token() {
             token.type = TOKEN_RIGHT_PAREN;
             break;
         case ':':
-			if (token.raw[1] == ':') {
-				scanner.current++;
+			if (raw[1] == ':') {
+				p++;
 				token.type = TOKEN_DOUBLE_COLON;
 			} else {
 				token.type = TOKEN_COLON;
@@ -185,40 +274,40 @@ static void scan_token() {
             token.type = TOKEN_COMMA;
             break;
         case '.':
-			if (token.raw[1] == '.' && token.raw[2] == '.') {
-				scanner.current +=2 ;
+			if (raw[1] == '.' && raw[2] == '.') {
+				p += 2;
 				token.type = TOKEN_TRIPLE_DOT;
 			} else {
 				token.type = TOKEN_DOT;
 			}
             break;
         case '!':
-			if (token.raw[1] == '=') {
-				scanner.current++;
+			if (raw[1] == '=') {
+				p++;
 				token.type = TOKEN_NOT_EQUAL;
 			} else {
 				token.type = TOKEN_ERROR;
 			}
             break;
         case '=':
-			if (token.raw[1] == '=') {
-				scanner.current++;
+			if (raw[1] == '=') {
+				p++;
 				token.type = TOKEN_DOUBLE_EQUAL;
 			} else {
 				token.type = TOKEN_EQUAL;
 			}
             break;
         case '&':
-			if (token.raw[1] == '&') {
-				scanner.current++;
+			if (raw[1] == '&') {
+				p++;
 				token.type = TOKEN_LOGICAL_AND;
 			} else {
 				token.type = TOKEN_ERROR;
 			}
             break;
         case '|':
-			if (token.raw[1] == '|') {
-				scanner.current++;
+			if (raw[1] == '|') {
+				p++;
 				token.type = TOKEN_LOGICAL_OR;
 			} else {
 				token.type = TOKEN_ERROR;
@@ -228,8 +317,8 @@ static void scan_token() {
             token.type = TOKEN_PLUS;
             break;
         case '-':
-			if (token.raw[1] == '>') {
-				scanner.current++;
+			if (raw[1] == '>') {
+				p++;
 				token.type = TOKEN_ARROW;
 			} else {
 				token.type = TOKEN_MINUS;
@@ -245,46 +334,75 @@ static void scan_token() {
             token.type = TOKEN_PERCENT;
             break;
         case '<':
-			if (token.raw[1] == '=') {
-				scanner.current++;
+			if (raw[1] == '=') {
+				p++;
 				token.type = TOKEN_LESS_THAN_OR_EQUAL;
 			} else {
 				token.type = TOKEN_LESS_THAN;
 			}
             break;
         case '>':
-			if (token.raw[1] == '=') {
-				scanner.current++;
+			if (raw[1] == '=') {
+				p++;
 				token.type = TOKEN_GREATER_THAN_OR_EQUAL;
 			} else {
 				token.type = TOKEN_GREATER_THAN;
 			}
             break;
         case '"':
-            token.type = scan_string() ? TOKEN_STRING : TOKEN_ERROR;
+			p = scan_string(p);
+            token.type = p[-1] == '"' && p - raw >= 2 ? TOKEN_STRING : TOKEN_ERROR;
             break;
         case '\0':
+			// Stay on the terminator, every following call returns EOF again
+			p = raw;
             token.type = TOKEN_EOF;
             break;
         default:
 			token.type = TOKEN_ERROR;
             break;
     }
-    token.length = scanner.current - start;
-    prev_token_type = token.type;
-    list_add(list, &token);
+	if (p - raw > UINT16_MAX) {
+		p = raw + UINT16_MAX;
+		token.type = TOKEN_ERROR;
+	}
+    token.length = p - raw;
+	stream->current = p - stream->source;
+    stream->prev_type = token.type;
+	return token;
 }
 
+void token_stream_init(TokenStream *stream, char *source) {
+	stream->source = source;
+	stream->current = 0;
+	stream->prev_type = TOKEN_EOF;
+	stream->newlines.elements = NULL;
+}
 
-void scan(char *source, List *tokens) {
-    scanner.source = source;
-    scanner.start = 0;
-    scanner.current = 0;
-    scanner.line = 1;
-    scanner.col = 1;
-    list = tokens;
+// Lines and columns are only needed for diagnostics, so the offsets of the
+// newlines are only collected the first time a position is asked for
+void token_position(TokenStream *stream, Token token, int *line, int *col) {
+	List *newlines = &stream->newlines;
+	if (newlines->elements == NULL) {
+		list_init(newlines, sizeof(int));
+		for (int i = 0; stream->source[i] != '\0'; i++) {
+			if (stream->source[i] == '\n') {
+				list_add(newlines, &i);
+			}
+		}
+	}
 
-    do {
-        scan_token();
-    } while (LIST_GET(Token, list, list->length - 1).type != TOKEN_EOF);
+	// Number of newlines before the token
+	int low = 0;
+	int high = newlines->length;
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (LIST_GET(int, newlines, mid) < (int)token.offset) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	*line = low + 1;
+	*col = low == 0 ? token.offset + 1 : token.offset - LIST_GET(int, newlines, low - 1);
 }
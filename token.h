@@ -1,6 +1,7 @@
 #ifndef PENQUIN_TOKEN_H
 #define PENQUIN_TOKEN_H
 
+#include <stdint.h>
 #include "list.h"
 
 typedef enum {
@@ -48,15 +49,26 @@ typedef enum {
     TOKEN_WHILE,
 } TokenType;
 
+// Tokens only point into the source, their line and column are worked out
+// with token_position() when a diagnostic needs them
 typedef struct {
-    int line;
-    int col;
-    TokenType type;
-    int length;
-    char *raw;
+    uint32_t offset;
+    uint16_t length;
+    uint8_t type;
 } Token;
 
+// Scans tokens on demand, once the end of the source is reached every
+// further token is TOKEN_EOF
+typedef struct {
+    char *source;
+    int current;
+    TokenType prev_type;
+    List newlines;
+} TokenStream;
+
 const char *token_type_to_string(TokenType type);
-void scan(char *source, List *tokens);
+Token token_next(TokenStream *stream);
+void token_position(TokenStream *stream, Token token, int *line, int *col);
+void token_stream_init(TokenStream *stream, char *source);
 
 #endif
@@ -0,0 +1,87 @@
+#include <string.h>
+#include "memory.h"
+#include "type.h"
+#include "table.h"
+
+static TypeInfo *create_type(Types *types, TypeType type, int tag) {
+	TypeInfo *type_info = arena_alloc(&types->arena, sizeof(TypeInfo));
+	memory_count(MEMORY_TYPES, sizeof(TypeInfo));
+	memset(type_info, 0, sizeof(TypeInfo));
+	type_info->type = type;
+	type_info->id = types->next_id++;
+	type_info->tag = tag;
+	return type_info;
+}
+
+static TypeInfo *create_value(Types *types, String name, int tag) {
+	char *p = arena_alloc(&types->arena, name.length + 1);
+	memory_count(MEMORY_TYPES, name.length + 1);
+	memcpy(p, name.p, name.length);
+	p[name.length] = '\0';
+
+	TypeInfo *type_info = create_type(types, TYPE_VALUE, tag);
+	type_info->value_of.p = p;
+	type_info->value_of.length = name.length;
+	table_put(&types->values, type_info->value_of, type_info);
+	return type_info;
+}
+
+TypeInfo *type_value(Types *types, String name) {
+	pthread_mutex_lock(&types->lock);
+	TypeInfo *type_info = table_get(&types->values, name);
+	if (type_info == NULL) {
+		type_info = create_value(types, name, types->next_value_tag++);
+	}
+	pthread_mutex_unlock(&types->lock);
+	return type_info;
+}
+
+TypeInfo *type_pointer(Types *types, TypeInfo *to) {
+	pthread_mutex_lock(&types->lock);
+	if (to->pointer == NULL) {
+		TypeInfo *type_info = create_type(types, TYPE_POINTER, TYPE_TAG_POINTER + to->tag);
+		type_info->pointer_to = to;
+		to->pointer = type_info;
+	}
+	pthread_mutex_unlock(&types->lock);
+	return to->pointer;
+}
+
+TypeInfo *type_array(Types *types, TypeInfo *of, int length) {
+	pthread_mutex_lock(&types->lock);
+	TypeInfo *type_info = of->arrays;
+	while (type_info != NULL && type_info->array.length != length) {
+		type_info = type_info->next_array;
+	}
+	if (type_info == NULL) {
+		type_info = create_type(types, TYPE_ARRAY, TYPE_TAG_ARRAY + of->tag);
+		type_info->array.of = of;
+		type_info->array.length = length;
+		type_info->next_array = of->arrays;
+		of->arrays = type_info;
+	}
+	pthread_mutex_unlock(&types->lock);
+	return type_info;
+}
+
+void type_free(Types *types) {
+	arena_free(&types->arena);
+	table_free(&types->values);
+	pthread_mutex_destroy(&types->lock);
+}
+
+void type_initialize(Types *types, bool huge_pages) {
+	pthread_mutex_init(&types->lock, NULL);
+	arena_init(&types->arena, huge_pages);
+	table_init(&types->values);
+	types->next_id = 0;
+
+	create_value(types, STRING("s1"), TYPE_TAG_S1);
+	create_value(types, STRING("s2"), TYPE_TAG_S2);
+	create_value(types, STRING("s4"), TYPE_TAG_S4);
+	create_value(types, STRING("s8"), TYPE_TAG_S8);
+	create_value(types, STRING("bool"), TYPE_TAG_BOOL);
+	create_value(types, STRING("any"), TYPE_TAG_ANY);
+	create_value(types, STRING("string"), TYPE_TAG_STRING);
+	types->next_value_tag = TYPE_TAG_STRING + 1;
+}
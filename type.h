@@ -0,0 +1,64 @@
+#ifndef PENQUIN_TYPE_H
+#define PENQUIN_TYPE_H
+
+#include <pthread.h>
+#include "arena.h"
+#include "common.h"
+#include "table.h"
+
+typedef enum {
+	TYPE_VALUE,
+	TYPE_ARRAY,
+	TYPE_POINTER,
+} TypeType;
+
+// Tags are what an `any` carries at runtime, so the builtin ones are fixed
+typedef enum {
+	TYPE_TAG_S1,
+	TYPE_TAG_S2,
+	TYPE_TAG_S4,
+	TYPE_TAG_S8,
+	TYPE_TAG_BOOL,
+	TYPE_TAG_ANY,
+	TYPE_TAG_STRING,
+} TypeTag;
+
+#define TYPE_TAG_POINTER 100
+#define TYPE_TAG_ARRAY 1000
+
+// Types are interned, every distinct type exists exactly once so types
+// can be compared by pointer or id.
+typedef struct TypeInfo {
+	TypeType type;
+	int id;
+	int tag;
+	struct TypeInfo *pointer;
+	struct TypeInfo *arrays;
+	struct TypeInfo *next_array;
+	union {
+		struct {
+			struct TypeInfo *of;
+			int length;
+		} array;
+		struct TypeInfo *pointer_to;
+		String value_of;
+	};
+} TypeInfo;
+
+// Type store of one compilation, locked since types are interned from the
+// parser and type checker threads
+typedef struct {
+	pthread_mutex_t lock;
+	Arena arena;
+	Table values;
+	int next_id;
+	int next_value_tag;
+} Types;
+
+TypeInfo *type_array(Types *types, TypeInfo *of, int length);
+void      type_free(Types *types);
+void      type_initialize(Types *types, bool huge_pages);
+TypeInfo *type_pointer(Types *types, TypeInfo *to);
+TypeInfo *type_value(Types *types, String name);
+
+#endif
@@ -1,137 +1,128 @@
 #include <assert.h>
 #include <stdlib.h>
 #include "typechecker.h"
+#include "compilation.h"
+#include "type.h"
 
-static TypeInfo *value_of(char *name) {
-	TypeInfo *type = malloc(sizeof(TypeInfo));
-	type->type = TYPE_VALUE;
-	type->value_of = STRING(name);
-	return type;
-}
-
-static TypeInfo *pointer_to(TypeInfo *to) {
-	TypeInfo *type = malloc(sizeof(TypeInfo));
-	type->type = TYPE_POINTER;
-	type->pointer_to = to;
-	return type;
-}
+// State of checking one module, modules are checked on several threads
+typedef struct {
+	Types *types;
+	TypeInfo *bool_type;
+	TypeInfo *s4_type;
+	TypeInfo *string_type;
+} Checker;
 
-static TypeInfo *array_of(TypeInfo *of, int length) {
-	TypeInfo *type = malloc(sizeof(TypeInfo));
-	type->type = TYPE_ARRAY;
-	type->array.of = of;
-	type->array.length = length;
-	return type;
-}
+static void parse_node(Checker *checker, AstNode *node);
 
-static void parse_node(AstNode *node);
-
-static void parse_accessor(AstNode *node) {
-	parse_node(node->as.accessor.left);
-	parse_node(node->as.accessor.right);
+static void parse_accessor(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.accessor.left);
+	parse_node(checker, node->as.accessor.right);
 	node->type_info = node->as.accessor.right->type_info;
 }
 
-static void parse_array(AstNode *node) {
+static void parse_array(Checker *checker, AstNode *node) {
 	AstNode *i_node;
 	for (int i = 0; i < node->as.array.items.length; i++) {
 		i_node = LIST_GET(AstNode *, &node->as.array.items, i);
-		parse_node(i_node);
+		parse_node(checker, i_node);
 	}
-	node->type_info = array_of(i_node->type_info, node->as.array.items.length);
+	node->type_info = type_array(checker->types, i_node->type_info, node->as.array.items.length);
 }
 
-static void parse_assignment(AstNode *node) {
+static void parse_assignment(Checker *checker, AstNode *node) {
 	if (node->as.assignment.type_info != NULL) {
 		assert(node->as.assignment.initial == node);
 		node->type_info = node->as.assignment.type_info;
 	}
 	if (node->as.assignment.value != NULL) {
-		parse_node(node->as.assignment.value);
-		if (node->as.assignment.type_info != NULL) {
-			// TODO: fail if mismatch between specified type and value
+		parse_node(checker, node->as.assignment.value);
+		// Types are interned, so they compare by pointer
+		TypeInfo *type_info = node->as.assignment.value->type_info;
+		if (node->as.assignment.type_info != NULL && type_info != node->as.assignment.type_info) {
+			fprintf(stderr, "Epic fail, %s is declared with another type than its value.\n", node->as.assignment.symbol->name.p);
+			fail();
 		}
-		if (node->as.assignment.initial != node) {
-			// TODO: fail if reassigning with another, incompatible type
+		AstNode *initial = node->as.assignment.initial;
+		if (initial != node && initial->type_info != NULL && type_info != initial->type_info) {
+			fprintf(stderr, "Epic fail, %s is assigned another type than it has.\n", node->as.assignment.symbol->name.p);
+			fail();
 		}
-		node->type_info = node->as.assignment.value->type_info;
+		node->type_info = type_info;
 	}
 }
 
-static void parse_block(AstNode *node) {
+static void parse_block(Checker *checker, AstNode *node) {
 	for (int i = 0; i < node->as.block.statements.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &node->as.block.statements, i);
-		parse_node(i_node);
+		parse_node(checker, i_node);
 	}
 }
 
-static void parse_bool(AstNode *node) {
-	node->type_info = value_of("bool");
+static void parse_bool(Checker *checker, AstNode *node) {
+	node->type_info = checker->bool_type;
 }
 
-static void parse_file_node(AstNode *node) {
+static void parse_file_node(Checker *checker, AstNode *node) {
 	for (int i = 0; i < node->as.file.nodes.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &node->as.file.nodes, i);
-		parse_node(i_node);
+		parse_node(checker, i_node);
 	}
 }
 
-static void parse_function(AstNode *node) {
+static void parse_function(Checker *checker, AstNode *node) {
 	// TODO: fix/refactor type structs
 	if (node->as.fn.type != NULL) {
-		char *type_name = String_to_cstring(node->as.fn.type->name);
+		node->type_info = type_value(checker->types, node->as.fn.type->name);
 		if (node->as.fn.type->pointer) {
-			node->type_info = pointer_to(value_of(type_name));
-		} else {
-			node->type_info = value_of(type_name);
+			node->type_info = type_pointer(checker->types, node->type_info);
 		}
 	}
 
 	for (int i = 0; i < node->as.fn.parameters.length; i++) {
 		AstNode *parameter_node = LIST_GET(AstNode *, &node->as.fn.parameters, i);
-		parse_node(parameter_node);
+		parse_node(checker, parameter_node);
 	}
 
 	for (int i = 0; i < node->as.fn.statements.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &node->as.fn.statements, i);
-		parse_node(i_node);
+		parse_node(checker, i_node);
 	}
 }
 
-static void parse_function_call(AstNode *node) {
-	parse_node(node->as.call.variable);
+static void parse_function_call(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.call.variable);
 	node->type_info = node->as.call.variable->type_info;
 	for (int i = 0; i < node->as.call.arguments.length; i++) {
 		AstNode *i_node = LIST_GET(AstNode *, &node->as.call.arguments, i);
-		parse_node(i_node);
+		parse_node(checker, i_node);
 	}
 }
 
 
-static void parse_if(AstNode *node) {
-	parse_node(node->as.if_.condition);
-	parse_node(node->as.if_.statement);
+static void parse_if(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.if_.condition);
+	parse_node(checker, node->as.if_.statement);
 	if (node->as.if_.else_statement != NULL) {
-		parse_node(node->as.if_.else_statement);
+		parse_node(checker, node->as.if_.else_statement);
 	}
 }
 
-static void parse_import(AstNode *node) {
+static void parse_import(Checker *checker, AstNode *node) {
 }
 
-static void parse_item_access(AstNode *node) {
-	parse_node(node->as.item_access.indexable);
-	parse_node(node->as.item_access.index);
+static void parse_item_access(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.item_access.indexable);
+	parse_node(checker, node->as.item_access.index);
 	node->type_info = node->as.item_access.indexable->type_info->pointer_to;
 }
 
-static void parse_match(AstNode *node) {
-	parse_node(node->as.match.matcher);
-	assert(String_cmp_cstring(node->as.match.matcher->type_info->value_of, "any") == 0);
+static void parse_match(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.match.matcher);
+	assert(node->as.match.matcher->type_info->tag == TYPE_TAG_ANY);
 	for (int i = 0; i < node->as.match.branches.length; i++) {
 		MatchBranch branch = LIST_GET(MatchBranch, &node->as.match.branches, i);
-		parse_node(branch.identifier);
-		parse_node(branch.expression);
+		parse_node(checker, branch.identifier);
+		parse_node(checker, branch.expression);
 		if (i == 0) {
 			node->type_info = branch.expression->type_info;
 		} else {
@@ -140,22 +131,25 @@ static void parse_match(AstNode *node) {
 	}
 }
 
-static void parse_number(AstNode *node) {
-	node->type_info = value_of("s4");
+static void parse_number(Checker *checker, AstNode *node) {
+	node->type_info = checker->s4_type;
 }
 
-static void parse_operator(AstNode *node) {
-	parse_node(node->as.operator_.left);
-	parse_node(node->as.operator_.right);
+static void parse_operator(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.operator_.left);
+	parse_node(checker, node->as.operator_.right);
 
-	assert(node->as.operator_.left->type_info->type == node->as.operator_.right->type_info->type);
+	if (node->as.operator_.left->type_info->type != node->as.operator_.right->type_info->type) {
+		fprintf(stderr, "Epic fail, the operands of %s have different types.\n", token_type_to_string(node->as.operator_.type));
+		fail();
+	}
 
 	switch (node->as.operator_.type) {
 		case TOKEN_PLUS:
 		case TOKEN_MINUS:
 		case TOKEN_STAR:
 		case TOKEN_SLASH:
-			node->type_info = value_of("s4");
+			node->type_info = checker->s4_type;
 			break;
 		case TOKEN_DOUBLE_EQUAL:
 		case TOKEN_LESS_THAN:
@@ -163,100 +157,105 @@ static void parse_operator(AstNode *node) {
 		case TOKEN_GREATER_THAN:
 		case TOKEN_GREATER_THAN_OR_EQUAL:
 		case TOKEN_NOT_EQUAL:
-			node->type_info = value_of("bool");
+			node->type_info = checker->bool_type;
 			break;
 		case TOKEN_LOGICAL_AND:
 		case TOKEN_LOGICAL_OR:
-			node->type_info = value_of("bool");
+			node->type_info = checker->bool_type;
 			break;
 		default:
 			break;
 	}
 }
 
-static void parse_parameter(AstNode *node) {
-	node->type_info = &node->as.parameter.type_info;
+static void parse_parameter(Checker *checker, AstNode *node) {
+	node->type_info = node->as.parameter.type_info;
 }
 
-static void parse_return(AstNode *node) {
-	parse_node(node->as.return_.expression);
+static void parse_return(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.return_.expression);
 }
 
-static void parse_string(AstNode *node) {
-	node->type_info = pointer_to(value_of("s1"));
+static void parse_string(Checker *checker, AstNode *node) {
+	node->type_info = checker->string_type;
 }
 
-static void parse_variable(AstNode *node) {
+static void parse_variable(Checker *checker, AstNode *node) {
 	node->type_info = node->as.variable.declaration->type_info;
 }
 
-static void parse_while(AstNode *node) {
-	parse_node(node->as.while_.condition);
-	parse_node(node->as.while_.statement);
+static void parse_while(Checker *checker, AstNode *node) {
+	parse_node(checker, node->as.while_.condition);
+	parse_node(checker, node->as.while_.statement);
 }
 
-static void parse_node(AstNode *node) {
+static void parse_node(Checker *checker, AstNode *node) {
 	switch (node->type) {
 		case AST_ACCESSOR:
-			parse_accessor(node);
+			parse_accessor(checker, node);
 			break;
 		case AST_ARRAY:
-			parse_array(node);
+			parse_array(checker, node);
 			break;
 		case AST_ASSIGNMENT:
-			parse_assignment(node);
+			parse_assignment(checker, node);
 			break;
 		case AST_BLOCK:
-			parse_block(node);
+			parse_block(checker, node);
 			break;
 		case AST_BOOL:
-			parse_bool(node);
+			parse_bool(checker, node);
 			break;
 		case AST_FILE:
-			parse_file_node(node);
+			parse_file_node(checker, node);
 			break;
 		case AST_FUNCTION:
-			parse_function(node);
+			parse_function(checker, node);
 			break;
 		case AST_FUNCTION_CALL:
-			parse_function_call(node);
+			parse_function_call(checker, node);
 			break;
 		case AST_IF:
-			parse_if(node);
+			parse_if(checker, node);
 			break;
 		case AST_IMPORT:
-			parse_import(node);
+			parse_import(checker, node);
 			break;
 		case AST_ITEM_ACCESS:
-			parse_item_access(node);
+			parse_item_access(checker, node);
 			break;
 		case AST_MATCH:
-			parse_match(node);
+			parse_match(checker, node);
 			break;
 		case AST_NUMBER:
-			parse_number(node);
+			parse_number(checker, node);
 			break;
 		case AST_OPERATOR:
-			parse_operator(node);
+			parse_operator(checker, node);
 			break;
 		case AST_PARAMETER:
-			parse_parameter(node);
+			parse_parameter(checker, node);
 			break;
 		case AST_RETURN:
-			parse_return(node);
+			parse_return(checker, node);
 			break;
 		case AST_STRING:
-			parse_string(node);
+			parse_string(checker, node);
 			break;
 		case AST_VARIABLE:
-			parse_variable(node);
+			parse_variable(checker, node);
 			break;
 		case AST_WHILE:
-			parse_while(node);
+			parse_while(checker, node);
 			break;
     }
 }
 
-void resolve_types(AstNode *node) {
-	parse_node(node);
+void resolve_types(Compilation *compilation, AstNode *node) {
+	Checker checker;
+	checker.types = &compilation->types;
+	checker.bool_type = type_value(checker.types, STRING("bool"));
+	checker.s4_type = type_value(checker.types, STRING("s4"));
+	checker.string_type = type_pointer(checker.types, type_value(checker.types, STRING("s1")));
+	parse_node(&checker, node);
 }
@@ -3,6 +3,6 @@
 
 #include "parser.h"
 
-void resolve_types(AstNode *node);
+void resolve_types(Compilation *compilation, AstNode *node);
 
 #endif